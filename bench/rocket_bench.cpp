@@ -0,0 +1,267 @@
+/*
+	Benchmarks for the rocket_sim library, on Google Benchmark:
+		collision at N meteors    all-pairs loop, grid, grid on the job pool
+		full step at N meteors    rocket, collision and integration
+		                          Both in two scenes: meteors where
+		                          init_simulation spawns them, in three
+		                          dense rows, and spread evenly over a
+		                          field that grows with N
+		step with churn           the same with 1% of the meteors replaced
+		                          every step
+		instance pool of N        one step of N default sized simulations
+		command dispatch          draining the I/O queue into the rocket
+		port transport            stdio and mmap port ops, legacy handshake
+		                          against the command ring
+		telemetry                 one frame as a word write per value
+		                          against the sequenced block write
+	Port benchmarks run against a scratch file in the working directory,
+	so no emulator is needed. Compare runs with the usual tools, e.g.
+		rocket_bench --benchmark_out=after.json --benchmark_out_format=json
+		compare.py benchmarks before.json after.json
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <benchmark/benchmark.h>
+#include "../src/command_dispatch.h"
+#include "../src/instance_pool.h"
+#include "../src/port_protocol.h"
+#include "../src/simulation.h"
+#include "../src/telemetry.h"
+#include "../src/virtual.h"
+
+#define BENCH_WIDTH 1020
+#define BENCH_HEIGHT 600
+#define BENCH_SEED 1
+#define BENCH_PORT_PATH "rocket_bench.io"
+#define ALL_PAIRS_LIMIT 20000
+#define BENCH_AREA_PER_METEOR 3000.0f // Square pixels, about DEFAULT_METEOR_CAP on the default screen
+
+enum BenchScene {
+    BENCH_SCENE_SPAWN,   // As init_simulation spawns them
+    BENCH_SCENE_UNIFORM, // Evenly spread at BENCH_AREA_PER_METEOR
+};
+
+// One pool for the whole run, threads are not part of what is measured
+static JobSystem *bench_jobs() {
+    static JobSystem jobs;
+    static bool started = false;
+    if (!started) {
+        init_job_system(&jobs, 0);
+        started = true;
+    }
+    return &jobs;
+}
+
+static void setup_simulation(Simulation *sim, int meteorCount, BroadPhase broadPhase, JobSystem *jobs,
+                             BenchScene scene = BENCH_SCENE_SPAWN) {
+    if (scene == BENCH_SCENE_SPAWN) {
+        init_simulation(sim, BENCH_WIDTH, BENCH_HEIGHT, meteorCount, BENCH_SEED);
+    } else {
+        // Same aspect as the screen, never smaller than it
+        int width = (int)sqrtf(meteorCount * BENCH_AREA_PER_METEOR * BENCH_WIDTH / BENCH_HEIGHT);
+        width = std::max(width, BENCH_WIDTH);
+        int height = width * BENCH_HEIGHT / BENCH_WIDTH;
+        init_simulation(sim, width, height, meteorCount, BENCH_SEED);
+        SimRandom random;
+        seed_sim_random(&random, BENCH_SEED);
+        for (int i = 0; i < sim->meteors.count; i++) {
+            sim->meteors.positionX[i] = (float)sim_random_value(&random, -METEOR_SPRITE_SIZE, width + METEOR_SPRITE_SIZE);
+            sim->meteors.positionY[i] = (float)sim_random_value(&random, -METEOR_SPRITE_SIZE, height + METEOR_SPRITE_SIZE);
+        }
+    }
+    sim->broadPhase = broadPhase;
+    sim->jobs = jobs;
+}
+
+// Collision only, nothing moves, so every iteration sees the same state
+static void run_collision(benchmark::State &state, BroadPhase broadPhase, JobSystem *jobs) {
+    Simulation sim = {};
+    setup_simulation(&sim, (int)state.range(0), broadPhase, jobs, (BenchScene)state.range(1));
+    for (auto _ : state) {
+        collide_meteors(&sim);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    free_simulation(&sim);
+}
+
+static void BM_CollisionAllPairs(benchmark::State &state) {
+    run_collision(state, BROAD_PHASE_ALL_PAIRS, nullptr);
+}
+
+static void BM_CollisionGrid(benchmark::State &state) {
+    run_collision(state, BROAD_PHASE_GRID, nullptr);
+}
+
+static void BM_CollisionGridParallel(benchmark::State &state) {
+    run_collision(state, BROAD_PHASE_GRID, bench_jobs());
+}
+
+static void BM_Step(benchmark::State &state) {
+    Simulation sim = {};
+    setup_simulation(&sim, (int)state.range(0), BROAD_PHASE_GRID, bench_jobs(), (BenchScene)state.range(1));
+    for (auto _ : state) {
+        step_simulation(&sim);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    free_simulation(&sim);
+}
+
+// Every step a wave of N/100 meteors spawns and as many expire, after a
+// warm up that fills the field to N
+static void BM_StepWithChurn(benchmark::State &state) {
+    const int meteorCount = (int)state.range(0);
+    Simulation sim = {};
+    setup_simulation(&sim, meteorCount, BROAD_PHASE_GRID, bench_jobs());
+    MeteorSpawn spawn = { 1, std::max(1, meteorCount / 100), meteorCount, 100, false };
+    set_meteor_spawn(&sim, &spawn);
+    for (int i = 0; i < 200; i++)
+        step_simulation(&sim);
+    for (auto _ : state) {
+        step_simulation(&sim);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    free_simulation(&sim);
+}
+
+// No ports, so this is stepping alone, spread over instances
+static void BM_InstancePool(benchmark::State &state) {
+    InstancePool pool;
+    init_instance_pool(&pool, (int)state.range(0), BENCH_WIDTH, BENCH_HEIGHT, DEFAULT_METEORS, BENCH_SEED,
+                       INSTANCE_PORTS_NONE, nullptr, 0, bench_jobs());
+    for (auto _ : state) {
+        step_instance_pool(&pool);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    free_instance_pool(&pool);
+}
+
+// A full queue of steering commands per iteration, the most a frame can see
+static void BM_CommandDispatch(benchmark::State &state) {
+    Simulation sim = {};
+    setup_simulation(&sim, 0, BROAD_PHASE_GRID, nullptr);
+    CommandQueue queue;
+    CommandRecorder recorder = {}; // No file, record_command returns early
+    InputStats stats = {};
+    const unsigned char steering[] = { ACCEL_POS, ROTATE_LEFT, ACCEL_NEG, ROTATE_RIGHT };
+    for (auto _ : state) {
+        state.PauseTiming();
+        unsigned head = queue.head.load(std::memory_order_relaxed);
+        IoClock::time_point now = IoClock::now();
+        for (unsigned i = 0; i < COMMAND_QUEUE_SIZE; i++)
+            queue.commands[(head + i) % COMMAND_QUEUE_SIZE] = TimedCommand{ steering[i % 4], now };
+        queue.head.store(head + COMMAND_QUEUE_SIZE, std::memory_order_release);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(dispatch_queued_commands(&queue, &sim.rocket, &recorder, 0, &stats));
+    }
+    state.SetItemsProcessed(state.iterations() * COMMAND_QUEUE_SIZE);
+    free_simulation(&sim);
+}
+
+static bool open_scratch_device(benchmark::State &state, IoTransport transport) {
+    FILE *fp = fopen(BENCH_PORT_PATH, "ab");
+    if (fp != NULL)
+        fclose(fp);
+    if (fp == NULL || init_virtual_device(BENCH_PORT_PATH, transport) != 0) {
+        state.SkipWithError("Cannot open " BENCH_PORT_PATH);
+        return false;
+    }
+    return true;
+}
+
+static void close_scratch_device() {
+    free_virtual_device();
+    remove(BENCH_PORT_PATH);
+}
+
+// Same mix as one frame of the old polling loop: status write, command
+// read, two resets
+static void BM_PortTransport(benchmark::State &state) {
+    if (!open_scratch_device(state, (IoTransport)state.range(0)))
+        return;
+    for (auto _ : state) {
+        write_port_byte(STATUS_PORT, 100);
+        benchmark::DoNotOptimize(read_port_byte(COMMAND_PORT));
+        write_port_byte(COMMAND_PORT, 0);
+        write_port_byte(STATUS_PORT, 99);
+    }
+    state.SetItemsProcessed(state.iterations() * 4);
+    state.SetLabel(state.range(0) == IO_TRANSPORT_STDIO ? "stdio" : "mmap");
+    close_scratch_device();
+}
+
+// Commands delivered through port_protocol, the program side is played
+// here. The ring is refilled and drained whole each iteration.
+static void BM_PortProtocol(benchmark::State &state) {
+    const int version = (int)state.range(0);
+    if (!open_scratch_device(state, IO_TRANSPORT_MMAP))
+        return;
+    write_port_byte(PROTOCOL_PORT, version);
+    write_port_byte(RING_HEAD_PORT, 0);
+    write_port_byte(RING_TAIL_PORT, 0);
+    PortProtocol protocol;
+    init_port_protocol(&protocol);
+
+    unsigned char commands[RING_SIZE];
+    unsigned char head = 0;
+    long delivered = 0;
+    for (auto _ : state) {
+        if (version == PROTOCOL_VERSION_RING) {
+            for (int slot = 0; slot < RING_SIZE; slot++, head++)
+                write_port_byte(RING_BASE_PORT + (head & RING_MASK), ACCEL_POS);
+            write_port_byte(RING_HEAD_PORT, head);
+        } else {
+            write_port_byte(COMMAND_PORT, ACCEL_POS);
+        }
+        delivered += receive_port_commands(&protocol, commands, RING_SIZE);
+    }
+    state.SetItemsProcessed(delivered);
+    state.SetLabel(version == PROTOCOL_VERSION_RING ? "ring" : "handshake");
+    free_port_protocol(&protocol);
+    close_scratch_device();
+}
+
+// One telemetry frame, with range(1) 0 written a word at a time like
+// the per-value port writes it replaces, 1 as publish_telemetry does
+static void BM_Telemetry(benchmark::State &state) {
+    const bool block = state.range(1) != 0;
+    if (!open_scratch_device(state, (IoTransport)state.range(0)))
+        return;
+    Simulation sim = {};
+    setup_simulation(&sim, DEFAULT_METEORS, BROAD_PHASE_GRID, nullptr);
+    Telemetry telemetry{};
+    update_telemetry(&telemetry, &sim);
+    for (auto _ : state) {
+        if (block) {
+            publish_telemetry(&telemetry, &ioDevice);
+        } else {
+            for (int i = 0; i < TELEMETRY_WORDS; i++)
+                write_port_word(TELEMETRY_PORT(i), telemetry.words[i]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::string(state.range(0) == IO_TRANSPORT_STDIO ? "stdio" : "mmap") + (block ? " block" : " per word"));
+    free_simulation(&sim);
+    close_scratch_device();
+}
+
+static const std::vector<int64_t> BENCH_SCENES = { BENCH_SCENE_SPAWN, BENCH_SCENE_UNIFORM };
+
+BENCHMARK(BM_CollisionAllPairs)->ArgsProduct({ benchmark::CreateRange(10, ALL_PAIRS_LIMIT, 10), BENCH_SCENES })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CollisionGrid)->ArgsProduct({ benchmark::CreateRange(10, MAX_METEORS, 10), BENCH_SCENES })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CollisionGridParallel)->ArgsProduct({ benchmark::CreateRange(10, MAX_METEORS, 10), BENCH_SCENES })->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_Step)->ArgsProduct({ benchmark::CreateRange(10, MAX_METEORS, 10), BENCH_SCENES })->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_StepWithChurn)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_InstancePool)->RangeMultiplier(10)->Range(1, 1000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_CommandDispatch);
+BENCHMARK(BM_PortTransport)->Arg(IO_TRANSPORT_STDIO)->Arg(IO_TRANSPORT_MMAP);
+BENCHMARK(BM_PortProtocol)->Arg(PROTOCOL_VERSION_LEGACY)->Arg(PROTOCOL_VERSION_RING);
+BENCHMARK(BM_Telemetry)->ArgsProduct({ { IO_TRANSPORT_STDIO, IO_TRANSPORT_MMAP }, { 0, 1 } });
+
+BENCHMARK_MAIN();
@@ -0,0 +1,274 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "asset_pack.h"
+#include "mapped_file.h"
+
+#define PACK_WRITE_ERR "Cannot write asset pack %s\n"
+#define PACK_SOURCE_ERR "Cannot bake asset pack, failed to load %s\n"
+
+#define ROCKET_SPRITE_FILE "Main Ship - Base - Full health.png"
+#define METEOR_SPRITE_FILE "Asteroid 01 - Base.png"
+#define FONT_FILE "font.ttf"
+
+// Same as LoadFontEx: ASCII 32..126 with 4 pixels of padding
+#define FONT_GLYPH_COUNT 95
+#define FONT_GLYPH_PADDING 4
+
+static const char *SOURCE_FILES[] = { ROCKET_SPRITE_FILE, METEOR_SPRITE_FILE, FONT_FILE };
+
+static std::string resource_path(const char *resourceDir, const char *file) {
+    return std::string(resourceDir) + "/" + file;
+}
+
+static uint64_t hash_value(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (8 * i)) & 0xFF;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Changes whenever a rebuilt pack would differ from an existing one.
+// Hashes file contents, not modification times, since copying the
+// resources into the build or install directory touches every file.
+static uint64_t source_stamp(const char *resourceDir, int width, int height) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hash_value(hash, ASSET_PACK_VERSION);
+    hash = hash_value(hash, ((uint64_t)width << 32) | (uint32_t)height);
+    hash = hash_value(hash, ((uint64_t)FONT_SIZE_SMALL << 32) | FONT_SIZE_LARGE);
+    for (const char *file : SOURCE_FILES) {
+        MappedFile source;
+        if (map_file(&source, resource_path(resourceDir, file).c_str()) != 0) {
+            hash = hash_value(hash, 0);
+            continue;
+        }
+        hash = hash_value(hash, source.size);
+        // A word at a time, the font alone is 2MB
+        size_t words = source.size / 8;
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word;
+            memcpy(&word, source.data + 8 * i, 8);
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (size_t i = 8 * words; i < source.size; i++)
+            hash = (hash ^ source.data[i]) * 1099511628211ull;
+        unmap_file(&source);
+    }
+    return hash;
+}
+
+typedef struct PackBuilder {
+    std::vector<AssetPackEntry> entries;
+    std::vector<unsigned char> data; // Offsets are relative to the start of this
+} PackBuilder;
+
+static uint64_t append_data(PackBuilder *builder, const void *bytes, size_t size) {
+    builder->data.resize((builder->data.size() + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT);
+    uint64_t offset = builder->data.size();
+    builder->data.insert(builder->data.end(), (const unsigned char *)bytes, (const unsigned char *)bytes + size);
+    return offset;
+}
+
+static AssetPackEntry *add_image(PackBuilder *builder, const char *name, Image image) {
+    AssetPackEntry entry = {};
+    strncpy(entry.name, name, ASSET_NAME_SIZE - 1);
+    entry.width = image.width;
+    entry.height = image.height;
+    entry.format = image.format;
+    entry.pixelsSize = GetPixelDataSize(image.width, image.height, image.format);
+    entry.pixelsOffset = append_data(builder, image.data, entry.pixelsSize);
+    builder->entries.push_back(entry);
+    return &builder->entries.back();
+}
+
+static bool add_font(PackBuilder *builder, const char *name, const unsigned char *ttf, int ttfSize, int fontSize) {
+    GlyphInfo *glyphs = LoadFontData(ttf, ttfSize, fontSize, NULL, FONT_GLYPH_COUNT, FONT_DEFAULT);
+    if (glyphs == NULL)
+        return false;
+    Rectangle *recs = NULL;
+    Image atlas = GenImageFontAtlas(glyphs, &recs, FONT_GLYPH_COUNT, fontSize, FONT_GLYPH_PADDING, 0);
+
+    std::vector<AssetPackGlyph> packed(FONT_GLYPH_COUNT);
+    for (int i = 0; i < FONT_GLYPH_COUNT; i++)
+        packed[i] = AssetPackGlyph{ glyphs[i].value, glyphs[i].offsetX, glyphs[i].offsetY, glyphs[i].advanceX, recs[i] };
+
+    AssetPackEntry *entry = add_image(builder, name, atlas);
+    entry->fontSize = fontSize;
+    entry->glyphCount = FONT_GLYPH_COUNT;
+    entry->glyphPadding = FONT_GLYPH_PADDING;
+    entry->glyphsOffset = append_data(builder, packed.data(), packed.size() * sizeof(AssetPackGlyph));
+
+    UnloadImage(atlas);
+    MemFree(recs);
+    UnloadFontData(glyphs, FONT_GLYPH_COUNT);
+    return true;
+}
+
+int bake_asset_pack(const char *resourceDir, const char *packPath, int width, int height) {
+    PackBuilder builder;
+
+    const char *sprites[2][2] = { { "rocket", ROCKET_SPRITE_FILE }, { "meteor", METEOR_SPRITE_FILE } };
+    for (const auto &sprite : sprites) {
+        std::string path = resource_path(resourceDir, sprite[1]);
+        Image image = LoadImage(path.c_str());
+        if (image.data == NULL) {
+            fprintf(stderr, PACK_SOURCE_ERR, path.c_str());
+            return -1;
+        }
+        add_image(&builder, sprite[0], image);
+        UnloadImage(image);
+    }
+
+    // Stored as one channel, GL swizzles it back to grey
+    Image noise = GenImagePerlinNoise(width, height, 50, 50, 2.5f);
+    ImageFormat(&noise, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+    add_image(&builder, "noise", noise);
+    UnloadImage(noise);
+
+    std::string fontPath = resource_path(resourceDir, FONT_FILE);
+    int ttfSize = 0;
+    unsigned char *ttf = LoadFileData(fontPath.c_str(), &ttfSize);
+    bool fontsBaked = ttf != NULL
+        && add_font(&builder, "font_small", ttf, ttfSize, FONT_SIZE_SMALL)
+        && add_font(&builder, "font_large", ttf, ttfSize, FONT_SIZE_LARGE);
+    UnloadFileData(ttf);
+    if (!fontsBaked) {
+        fprintf(stderr, PACK_SOURCE_ERR, fontPath.c_str());
+        return -1;
+    }
+
+    AssetPackHeader header = { ASSET_PACK_MAGIC, ASSET_PACK_VERSION, source_stamp(resourceDir, width, height),
+                               (uint32_t)builder.entries.size(), 0 };
+    const size_t tableSize = sizeof(header) + builder.entries.size() * sizeof(AssetPackEntry);
+    const size_t dataStart = (tableSize + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+    for (AssetPackEntry &entry : builder.entries) {
+        entry.pixelsOffset += dataStart;
+        if (entry.glyphCount > 0)
+            entry.glyphsOffset += dataStart;
+    }
+
+    // Write next to the pack and rename, so a session starting at the
+    // same time never maps a half written file
+    std::string tempPath = std::string(packPath) + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, PACK_WRITE_ERR, packPath);
+        return -1;
+    }
+    const unsigned char padding[ASSET_PACK_ALIGNMENT] = {};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(builder.entries.data(), sizeof(AssetPackEntry), builder.entries.size(), file) == builder.entries.size()
+        && fwrite(padding, 1, dataStart - tableSize, file) == dataStart - tableSize
+        && fwrite(builder.data.data(), 1, builder.data.size(), file) == builder.data.size();
+    written = fclose(file) == 0 && written;
+    remove(packPath);
+    if (!written || rename(tempPath.c_str(), packPath) != 0) {
+        remove(tempPath.c_str());
+        fprintf(stderr, PACK_WRITE_ERR, packPath);
+        return -1;
+    }
+    return 0;
+}
+
+static const AssetPackEntry *find_entry(const MappedFile *pack, const char *name) {
+    const AssetPackHeader *header = (const AssetPackHeader *)pack->data;
+    const AssetPackEntry *entries = (const AssetPackEntry *)(pack->data + sizeof(AssetPackHeader));
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const AssetPackEntry *entry = &entries[i];
+        if (strncmp(entry->name, name, ASSET_NAME_SIZE) != 0)
+            continue;
+        bool inside = entry->pixelsOffset + entry->pixelsSize <= pack->size
+            && (entry->glyphCount == 0 || entry->glyphsOffset + entry->glyphCount * sizeof(AssetPackGlyph) <= pack->size);
+        return inside ? entry : nullptr;
+    }
+    return nullptr;
+}
+
+// The Image points into the mapping, it must not be unloaded and is
+// only good until the pack is unmapped. Upload it, don't keep it.
+static Image mapped_image(const MappedFile *pack, const AssetPackEntry *entry) {
+    return Image{ (void *)(pack->data + entry->pixelsOffset), entry->width, entry->height, 1, entry->format };
+}
+
+static Font mapped_font(const MappedFile *pack, const AssetPackEntry *entry) {
+    Font font = {};
+    font.baseSize = entry->fontSize;
+    font.glyphCount = entry->glyphCount;
+    font.glyphPadding = entry->glyphPadding;
+    font.texture = LoadTextureFromImage(mapped_image(pack, entry));
+    // UnloadFont frees these, so they must come from raylib's allocator
+    font.recs = (Rectangle *)MemAlloc(font.glyphCount * sizeof(Rectangle));
+    font.glyphs = (GlyphInfo *)MemAlloc(font.glyphCount * sizeof(GlyphInfo));
+    const AssetPackGlyph *glyphs = (const AssetPackGlyph *)(pack->data + entry->glyphsOffset);
+    for (int i = 0; i < font.glyphCount; i++) {
+        font.recs[i] = glyphs[i].rec;
+        font.glyphs[i] = GlyphInfo{ glyphs[i].value, glyphs[i].offsetX, glyphs[i].offsetY, glyphs[i].advanceX, Image{} };
+    }
+    return font;
+}
+
+static bool load_from_pack(GameAssets *assets, const char *packPath, uint64_t stamp) {
+    MappedFile pack;
+    if (map_file(&pack, packPath) != 0)
+        return false;
+
+    const AssetPackHeader *header = (const AssetPackHeader *)pack.data;
+    bool valid = pack.size >= sizeof(AssetPackHeader)
+        && header->magic == ASSET_PACK_MAGIC && header->version == ASSET_PACK_VERSION && header->stamp == stamp
+        && sizeof(AssetPackHeader) + header->entryCount * sizeof(AssetPackEntry) <= pack.size;
+    const AssetPackEntry *rocket = valid ? find_entry(&pack, "rocket") : nullptr;
+    const AssetPackEntry *meteor = valid ? find_entry(&pack, "meteor") : nullptr;
+    const AssetPackEntry *noise = valid ? find_entry(&pack, "noise") : nullptr;
+    const AssetPackEntry *fontSmall = valid ? find_entry(&pack, "font_small") : nullptr;
+    const AssetPackEntry *fontLarge = valid ? find_entry(&pack, "font_large") : nullptr;
+    if (!rocket || !meteor || !noise || !fontSmall || !fontLarge) {
+        unmap_file(&pack);
+        return false;
+    }
+
+    assets->rocketSprite = LoadTextureFromImage(mapped_image(&pack, rocket));
+    assets->meteorSprite = LoadTextureFromImage(mapped_image(&pack, meteor));
+    assets->noise = LoadTextureFromImage(mapped_image(&pack, noise));
+    assets->font = mapped_font(&pack, fontSmall);
+    assets->fontLarge = mapped_font(&pack, fontLarge);
+    // Textures are on the GPU and the glyph tables copied, so the pack
+    // does not have to stay mapped
+    unmap_file(&pack);
+    return true;
+}
+
+static void load_from_sources(GameAssets *assets, const char *resourceDir, int width, int height) {
+    std::string fontPath = resource_path(resourceDir, FONT_FILE);
+    assets->rocketSprite = LoadTexture(resource_path(resourceDir, ROCKET_SPRITE_FILE).c_str());
+    assets->meteorSprite = LoadTexture(resource_path(resourceDir, METEOR_SPRITE_FILE).c_str());
+    assets->font = LoadFontEx(fontPath.c_str(), FONT_SIZE_SMALL, NULL, FONT_GLYPH_COUNT);
+    assets->fontLarge = LoadFontEx(fontPath.c_str(), FONT_SIZE_LARGE, NULL, FONT_GLYPH_COUNT);
+    Image noiseImage = GenImagePerlinNoise(width, height, 50, 50, 2.5f);
+    assets->noise = LoadTextureFromImage(noiseImage);
+    UnloadImage(noiseImage);
+}
+
+void load_game_assets(GameAssets *assets, const char *resourceDir, int width, int height) {
+    const std::string packPath = resource_path(resourceDir, ASSET_PACK_NAME);
+    const uint64_t stamp = source_stamp(resourceDir, width, height);
+
+    assets->source = ASSETS_FROM_PACK;
+    if (load_from_pack(assets, packPath.c_str(), stamp))
+        return;
+    assets->source = ASSETS_BAKED;
+    if (bake_asset_pack(resourceDir, packPath.c_str(), width, height) == 0 && load_from_pack(assets, packPath.c_str(), stamp))
+        return;
+    assets->source = ASSETS_FROM_SOURCES;
+    load_from_sources(assets, resourceDir, width, height);
+}
+
+void unload_game_assets(GameAssets *assets) {
+    UnloadTexture(assets->rocketSprite);
+    UnloadTexture(assets->meteorSprite);
+    UnloadTexture(assets->noise);
+    UnloadFont(assets->font);
+    UnloadFont(assets->fontLarge);
+    *assets = GameAssets{};
+}
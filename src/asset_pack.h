@@ -0,0 +1,89 @@
+/*
+	Baked assets. Decoding the sprites, rasterizing the font and
+	generating the noise image is done once, by the bake_assets target
+	or on the first run, and the results are written as raw pixels to
+	one pack file. Later runs memory-map the pack, upload the pixels
+	straight from the mapping and unmap it again: once the textures are
+	on the GPU and the glyph tables copied, nothing points into it.
+
+	Layout (native byte order, little endian on every target we ship):
+		AssetPackHeader
+		AssetPackEntry[entryCount]
+		data, every blob aligned to ASSET_PACK_ALIGNMENT
+	Fonts store their atlas as pixels plus AssetPackGlyph[glyphCount].
+
+	The header carries a stamp of the pack version, the screen size and
+	the contents of every source file. A pack with a different stamp is
+	rebuilt.
+*/
+#pragma once
+
+#include <cstdint>
+#include <raylib.h>
+
+// Window size, the noise texture is baked to cover it
+#define SCREEN_WIDTH 1020
+#define SCREEN_HEIGHT 600
+
+// Sizes the HUD text is drawn at, rasterized 1:1 so no glyph is scaled
+#define FONT_SIZE_SMALL 20
+#define FONT_SIZE_LARGE 30
+
+#define ASSET_PACK_NAME "assets.pack"
+#define ASSET_PACK_MAGIC 0x4B415052 // "RPAK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGNMENT 16
+#define ASSET_NAME_SIZE 16
+
+typedef struct AssetPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t stamp;
+    uint32_t entryCount;
+    uint32_t reserved;
+} AssetPackHeader;
+
+typedef struct AssetPackEntry {
+    char name[ASSET_NAME_SIZE];
+    int32_t width;
+    int32_t height;
+    int32_t format;       // PixelFormat
+    int32_t fontSize;     // Fonts only, 0 for plain images
+    int32_t glyphCount;
+    int32_t glyphPadding;
+    uint64_t pixelsOffset;
+    uint64_t pixelsSize;
+    uint64_t glyphsOffset;
+} AssetPackEntry;
+
+typedef struct AssetPackGlyph {
+    int32_t value;
+    int32_t offsetX;
+    int32_t offsetY;
+    int32_t advanceX;
+    Rectangle rec; // Position in the atlas
+} AssetPackGlyph;
+
+enum AssetSource {
+    ASSETS_FROM_PACK,
+    ASSETS_BAKED,        // Pack was missing or stale and was rebuilt first
+    ASSETS_FROM_SOURCES, // Pack could not be written, loaded the slow way
+};
+
+typedef struct GameAssets {
+    Texture2D rocketSprite;
+    Texture2D meteorSprite;
+    Texture2D noise;
+    Font font;      // FONT_SIZE_SMALL
+    Font fontLarge; // FONT_SIZE_LARGE
+    AssetSource source;
+} GameAssets;
+
+// Build the pack from the files in resourceDir. Needs no window.
+// Returns 0 on success.
+int bake_asset_pack(const char *resourceDir, const char *packPath, int width, int height);
+
+// Load everything from resourceDir/ASSET_PACK_NAME, (re)baking it first
+// when it is missing or stale. Needs a window (uploads textures).
+void load_game_assets(GameAssets *assets, const char *resourceDir, int width, int height);
+void unload_game_assets(GameAssets *assets);
@@ -0,0 +1,276 @@
+#start=rocket.exe#
+
+#make_bin#
+
+name "autopilot"
+
+; Flies the rocket on its own from the telemetry block: away from the
+; nearest meteor when it gets close, back to the middle of the screen
+; otherwise. Press any key to exit.
+
+; Port value constants (see port_protocol.h)
+STATUS_PORT    equ 11
+PROTOCOL_PORT  equ 12
+RING_HEAD_PORT equ 13 ; Written by us: next free slot
+RING_TAIL_PORT equ 14 ; Written by the device: next slot it reads
+RING_BASE_PORT equ 16
+RING_SIZE      equ 16
+RING_MASK      equ 0Fh
+
+PROTOCOL_VERSION_RING equ 2
+
+; Telemetry words, TELEMETRY_PORT(word) = 32 + 2 * word. Each is read
+; with one `in ax, port`.
+SEQUENCE_PORT        equ 32
+ROCKET_X_PORT        equ 36
+ROCKET_Y_PORT        equ 38
+HEADING_X_PORT       equ 44
+HEADING_Y_PORT       equ 46
+ACCELERATION_PORT    equ 50
+METEOR_DX_PORT       equ 52
+METEOR_DY_PORT       equ 54
+METEOR_DISTANCE_PORT equ 56
+
+CENTRE_X       equ 510
+CENTRE_Y       equ 300
+DANGER_DISTANCE equ 150  ; Pixels, closer meteors are run away from
+CRUISE_ACCEL   equ 20    ; 1/100, same units as ACCELERATION_PORT
+ESCAPE_ACCEL   equ 60
+DEADBAND       equ 2000  ; Heading cross target below this flies straight
+
+; Use the command ring (protocol v2), same setup as rocket.asm
+mov al, 0
+out RING_HEAD_PORT, al
+out RING_TAIL_PORT, al
+mov al, PROTOCOL_VERSION_RING
+out PROTOCOL_PORT, al
+
+; READY, the device starts stepping and publishing telemetry
+mov al, 45h
+out STATUS_PORT, al
+
+mov dx, offset helper_msg
+call print_msg
+
+main:
+    ; Any key exits, without waiting for one
+    mov ah, 1
+    int 16h
+    jnz end
+
+    call read_frame
+    jc main     ; No new frame yet
+    call steer
+    call publish_commands
+    jmp main
+
+; Copy the words we use out of the telemetry block. Returns with carry
+; set if there is no new complete frame: the sequence is odd while the
+; device writes, and changes if it wrote while we were reading.
+read_frame proc
+    in ax, SEQUENCE_PORT
+    test al, 1
+    jnz no_frame
+    cmp ax, last_sequence
+    jz no_frame
+    mov cx, ax
+
+    in ax, ROCKET_X_PORT
+    mov rocket_x, ax
+    in ax, ROCKET_Y_PORT
+    mov rocket_y, ax
+    in ax, HEADING_X_PORT
+    mov heading_x, ax
+    in ax, HEADING_Y_PORT
+    mov heading_y, ax
+    in ax, ACCELERATION_PORT
+    mov acceleration, ax
+    in ax, METEOR_DX_PORT
+    mov meteor_dx, ax
+    in ax, METEOR_DY_PORT
+    mov meteor_dy, ax
+    in ax, METEOR_DISTANCE_PORT
+    mov meteor_distance, ax
+
+    in ax, SEQUENCE_PORT
+    cmp ax, cx
+    jnz no_frame ; Torn, read the next one
+    mov last_sequence, cx
+    clc
+    ret
+no_frame:
+    stc
+    ret
+read_frame endp
+
+; Queue at most one rotation and one thrust command for this frame
+steer proc
+    ; Pick the direction to fly in
+    mov ax, meteor_distance
+    cmp ax, DANGER_DISTANCE
+    jge go_home
+    mov ax, meteor_dx
+    neg ax
+    mov target_x, ax
+    mov ax, meteor_dy
+    neg ax
+    mov target_y, ax
+    mov target_accel, ESCAPE_ACCEL
+    jmp turn
+go_home:
+    mov ax, CENTRE_X
+    sub ax, rocket_x
+    mov target_x, ax
+    mov ax, CENTRE_Y
+    sub ax, rocket_y
+    mov target_y, ax
+    mov target_accel, CRUISE_ACCEL
+
+    ; cross = heading_x * target_y - heading_y * target_x, 32 bits in
+    ; di:si. Positive means the target is clockwise of the nose.
+turn:
+    mov ax, heading_x
+    imul target_y
+    mov si, ax
+    mov di, dx
+    mov ax, heading_y
+    imul target_x
+    sub si, ax
+    sbb di, dx
+
+    ; dot = heading_x * target_x + heading_y * target_y, 32 bits in
+    ; bx:cx. Negative means the target is behind the nose, where cross
+    ; is small too, so the deadband alone would fly away from it.
+    mov ax, heading_x
+    imul target_x
+    mov cx, ax
+    mov bx, dx
+    mov ax, heading_y
+    imul target_y
+    add cx, ax
+    adc bx, dx
+    test bx, 8000h
+    jz in_front
+    ; Behind: always turn, and ease off so we do not fly the wrong way
+    ; while the nose comes round
+    mov target_accel, 0
+    jmp pick_side
+
+    ; Inside the deadband the nose is close enough, keep going straight
+in_front:
+    cmp di, 0
+    jnz outside_deadband
+    cmp si, DEADBAND
+    jb thrust
+    jmp turn_right
+outside_deadband:
+    cmp di, 0FFFFh
+    jnz pick_side
+    cmp si, -DEADBAND
+    ja thrust
+    ; Clockwise when cross is 0, the target is then straight behind
+pick_side:
+    test di, 8000h
+    jnz turn_left
+turn_right:
+    mov al, 3h ; Command::ROTATE_RIGHT
+    call push_command
+    jmp thrust
+turn_left:
+    mov al, 4h ; Command::ROTATE_LEFT
+    call push_command
+
+    ; One ACCEL_POS or ACCEL_NEG towards target_accel
+thrust:
+    mov ax, acceleration
+    cmp ax, target_accel
+    jz steer_done
+    jl speed_up
+    mov al, 2h ; Command::ACCEL_NEG
+    call push_command
+    jmp steer_done
+speed_up:
+    mov al, 1h ; Command::ACCEL_POS
+    call push_command
+steer_done:
+    ret
+steer endp
+
+; Write the command in `al` into the next ring slot. Does not publish it.
+; If the ring is full, publish what we have and wait for the device.
+push_command proc
+    push bx
+    push dx
+    mov bl, al
+wait_for_slot:
+    in al, RING_TAIL_PORT
+    mov ah, ring_head
+    sub ah, al        ; Commands in flight (mod 256)
+    cmp ah, RING_SIZE
+    jb slot_free
+    call publish_commands
+    jmp wait_for_slot
+slot_free:
+    mov al, ring_head
+    and al, RING_MASK
+    mov dx, RING_BASE_PORT
+    add dl, al        ; RING_BASE_PORT + (head & RING_MASK), never carries
+    mov al, bl
+    out dx, al
+    inc ring_head
+    pop dx
+    pop bx
+    ret
+push_command endp
+
+; Make every slot written so far visible to the device
+publish_commands proc
+    mov al, ring_head
+    out RING_HEAD_PORT, al
+    ret
+publish_commands endp
+
+; Need to set start offset to msg in dx before calling print_msg
+; mov dx, offset msg
+print_msg proc
+mov ah, 9
+int 21h
+ret
+print_msg endp
+
+; Free running copy of RING_HEAD_PORT
+ring_head db 0
+
+; Sequence of the last frame acted on, odd so the first even one is new
+last_sequence dw 0FFFFh
+
+; Copy of the last frame
+rocket_x        dw 0
+rocket_y        dw 0
+heading_x       dw 0
+heading_y       dw 0
+acceleration    dw 0
+meteor_dx       dw 0
+meteor_dy       dw 0
+meteor_distance dw 0
+
+target_x        dw 0
+target_y        dw 0
+target_accel    dw 0
+
+; Strings
+helper_msg db "Autopilot engaged. Press any key to exit!", 0Dh,0Ah, "$"
+exit_msg db   "Shutting down device. Exiting!",           0Dh,0Ah, "$"
+
+
+; End procedure. Perform de-initialization of virtual device properly.
+; EXIT goes through the ring behind any commands still queued.
+end:
+mov ah, 0 ; Take the key out of the buffer
+int 16h
+mov dx, offset exit_msg
+call print_msg
+mov al, 5h ; 0x5 is Command::EXIT
+call push_command
+call publish_commands
+hlt
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <raylib.h>
+#include "background.h"
+
+// Opacity of the noise cloud over the stars
+#define NOISE_ALPHA 30
+
+static void load_target(Background *background, float scale) {
+    background->scale = scale;
+    int width = std::max(1, (int)(background->width * scale));
+    int height = std::max(1, (int)(background->height * scale));
+    background->target = LoadRenderTexture(width, height);
+    SetTextureFilter(background->target.texture, TEXTURE_FILTER_BILINEAR);
+}
+
+// Same distribution the old stars.fs had: about one pixel in 250 is a
+// star with a random peak brightness. Uploaded once, the pixels are not
+// kept on the CPU.
+static void generate_stars(Background *background) {
+    const int width = background->width;
+    const int height = background->height;
+    std::mt19937 random(STAR_FIELD_SEED);
+    std::uniform_int_distribution<int> x(0, width - 1);
+    std::uniform_int_distribution<int> y(0, height - 1);
+    std::uniform_real_distribution<float> phase(0.0f, 1.0f);
+    std::vector<float> pixels((size_t)width * height, 0.0f);
+    int count = (int)(width * height * STAR_DENSITY);
+    for (int i = 0; i < count; i++) {
+        int column = x(random);
+        int row = y(random);
+        pixels[(size_t)row * width + column] = phase(random);
+    }
+    Image image = { pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R32 };
+    background->stars = LoadTextureFromImage(image);
+    // One texel per screen pixel, never blend neighbouring stars
+    SetTextureFilter(background->stars, TEXTURE_FILTER_POINT);
+}
+
+void init_background(Background *background, Texture2D noise, int width, int height, float scale, bool adaptive) {
+    background->width = width;
+    background->height = height;
+    background->adaptive = adaptive;
+    background->noise = noise;
+    load_target(background, std::clamp(scale, BACKGROUND_MIN_SCALE, BACKGROUND_MAX_SCALE));
+
+    background->noiseShader = LoadShader(0, "resources/space_noise.fs");
+    background->secondsLoc = GetShaderLocation(background->noiseShader, "seconds");
+    // Distortion is given in screen pixels, whatever the target size
+    const float size[2] = { (float)width, (float)height };
+    const float freq = 10.0f;
+    const float amp = 2.0f;
+    const float speed = 3.0f;
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "size"), size, SHADER_UNIFORM_VEC2);
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "freqX"), &freq, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "freqY"), &freq, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "ampX"), &amp, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "ampY"), &amp, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "speedX"), &speed, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(background->noiseShader, GetShaderLocation(background->noiseShader, "speedY"), &speed, SHADER_UNIFORM_FLOAT);
+
+    generate_stars(background);
+    background->starShader = LoadShader(0, "resources/stars.fs");
+    background->starSecondsLoc = GetShaderLocation(background->starShader, "seconds");
+    // The old stars.fs drew the stars first and the noise cloud over
+    // them. Adding the stars dimmed by the cloud's opacity gives the
+    // same pixels.
+    const float dim = 1.0f - NOISE_ALPHA / 255.0f;
+    SetShaderValue(background->starShader, GetShaderLocation(background->starShader, "dim"), &dim, SHADER_UNIFORM_FLOAT);
+
+    background->frameTimeSum = 0.0f;
+    background->frameCount = 0;
+    background->framesOnBudget = 0;
+    background->probeFrames = BACKGROUND_PROBE_FRAMES;
+    background->probing = false;
+}
+
+void unload_background(Background *background) {
+    UnloadRenderTexture(background->target);
+    UnloadShader(background->noiseShader);
+    UnloadTexture(background->stars);
+    UnloadShader(background->starShader);
+}
+
+void adapt_background_scale(Background *background, float frameTime, float targetFrameTime) {
+    if (!background->adaptive || targetFrameTime <= 0.0f)
+        return;
+    background->frameTimeSum += frameTime;
+    if (++background->frameCount < BACKGROUND_ADAPT_FRAMES)
+        return;
+    const float average = background->frameTimeSum / background->frameCount;
+    background->frameTimeSum = 0.0f;
+    background->frameCount = 0;
+
+    float scale = background->scale;
+    if (average > 1.1f * targetFrameTime) {
+        // A step up that did not fit, wait longer before the next one
+        if (background->probing)
+            background->probeFrames = std::min(2 * background->probeFrames, BACKGROUND_MAX_PROBE_FRAMES);
+        background->probing = false;
+        background->framesOnBudget = 0;
+        scale -= BACKGROUND_SCALE_STEP;
+    } else {
+        background->framesOnBudget += BACKGROUND_ADAPT_FRAMES;
+        if (background->framesOnBudget >= background->probeFrames) {
+            background->framesOnBudget = 0;
+            background->probing = true;
+            scale += BACKGROUND_SCALE_STEP;
+        }
+    }
+    scale = std::clamp(scale, BACKGROUND_MIN_SCALE, BACKGROUND_MAX_SCALE);
+    if (scale != background->scale) {
+        UnloadRenderTexture(background->target);
+        load_target(background, scale);
+    }
+}
+
+void render_background(Background *background, float seconds) {
+    SetShaderValue(background->noiseShader, background->secondsLoc, &seconds, SHADER_UNIFORM_FLOAT);
+    const Texture2D &target = background->target.texture;
+    BeginTextureMode(background->target);
+    ClearBackground(BLACK);
+    BeginShaderMode(background->noiseShader);
+    DrawTexturePro(background->noise, Rectangle{ 0, 0, (float)background->noise.width, (float)background->noise.height },
+                   Rectangle{ 0, 0, (float)target.width, (float)target.height }, Vector2{ 0, 0 }, 0.0f,
+                   Color{ 255, 255, 255, NOISE_ALPHA });
+    EndShaderMode();
+    EndTextureMode();
+}
+
+void draw_background(const Background *background, float seconds) {
+    // The target is opaque and the screen is black, so this is a copy
+    const Texture2D &target = background->target.texture;
+    BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+    DrawTexturePro(target, Rectangle{ 0, 0, (float)target.width, -(float)target.height },
+                   Rectangle{ 0, 0, (float)background->width, (float)background->height }, Vector2{ 0, 0 }, 0.0f, WHITE);
+    EndBlendMode();
+
+    // The same stars every frame, only the twinkle is computed, in one quad
+    SetShaderValue(background->starShader, background->starSecondsLoc, &seconds, SHADER_UNIFORM_FLOAT);
+    BeginBlendMode(BLEND_ADDITIVE);
+    BeginShaderMode(background->starShader);
+    DrawTexture(background->stars, 0, 0, WHITE);
+    EndShaderMode();
+    EndBlendMode();
+}
@@ -0,0 +1,61 @@
+/*
+	Space background: the distorted noise cloud (space_noise.fs) and the
+	twinkling stars.
+
+	The noise pass is rendered into an offscreen target at a fraction of
+	the screen resolution and upscaled with bilinear filtering. The noise
+	is smooth, so half resolution or lower is hard to tell apart. The
+	scale is fixed, or adapted to frame time: it drops a step when frames
+	run over budget and probes a step up after a long run on budget.
+
+	The star field is static except for the twinkle. The stars are
+	generated once, straight into a float texture that holds each star's
+	twinkle phase and 0 everywhere else. Every frame that texture is
+	drawn with one quad through stars.fs, which only evaluates the
+	twinkle term, instead of a draw call per star.
+*/
+#pragma once
+
+#include <raylib.h>
+
+#define BACKGROUND_MIN_SCALE 0.25f
+#define BACKGROUND_MAX_SCALE 1.0f
+#define BACKGROUND_DEFAULT_SCALE 0.5f
+#define BACKGROUND_SCALE_STEP 0.125f
+#define BACKGROUND_ADAPT_FRAMES 60   // Frames averaged for each decision
+#define BACKGROUND_PROBE_FRAMES 600  // Frames on budget before trying a larger scale
+#define BACKGROUND_MAX_PROBE_FRAMES (16 * BACKGROUND_PROBE_FRAMES)
+
+#define STAR_DENSITY 0.004f // Fraction of screen pixels that are stars
+#define STAR_FIELD_SEED 1   // Fixed so the sky looks the same every run
+
+typedef struct Background {
+    int width;  // Screen size
+    int height;
+    float scale;
+    bool adaptive;
+    RenderTexture2D target;
+    Texture2D noise;
+    Shader noiseShader;
+    int secondsLoc;
+    Texture2D stars;   // Screen sized, twinkle phase of each star, also its peak brightness
+    Shader starShader;
+    int starSecondsLoc;
+
+    float frameTimeSum;
+    int frameCount;
+    int framesOnBudget;
+    int probeFrames;   // Doubles every time a probe went over budget
+    bool probing;      // The last change was a step up
+} Background;
+
+void init_background(Background *background, Texture2D noise, int width, int height, float scale, bool adaptive);
+void unload_background(Background *background);
+
+// Feed the last frame time. Only changes the scale when adaptive.
+void adapt_background_scale(Background *background, float frameTime, float targetFrameTime);
+
+// Render the noise pass offscreen. Call before BeginDrawing.
+void render_background(Background *background, float seconds);
+// Upscale the noise pass and draw the stars over it
+void draw_background(const Background *background, float seconds);
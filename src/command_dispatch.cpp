@@ -0,0 +1,22 @@
+#include "command_dispatch.h"
+
+void dispatch_command(Rocket *rocket, CommandRecorder *recorder, uint64_t step, int command) {
+    record_command(recorder, step, command);
+    apply_command(rocket, command);
+}
+
+int dispatch_queued_commands(CommandQueue *queue, Rocket *rocket, CommandRecorder *recorder, uint64_t step, InputStats *stats) {
+    int lastCommand = Command::NOP;
+    TimedCommand command;
+    while (pop_command(queue, &command)) {
+        stats->lastLatencyMs = std::chrono::duration<double, std::milli>(IoClock::now() - command.arrival).count();
+        stats->totalLatencyMs += stats->lastLatencyMs;
+        stats->commandsApplied++;
+        dispatch_command(rocket, recorder, step, command.command);
+        if (command.command == Command::EXIT)
+            return Command::EXIT;
+        if (command.command != Command::NOP)
+            lastCommand = command.command;
+    }
+    return lastCommand;
+}
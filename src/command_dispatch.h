@@ -0,0 +1,25 @@
+/*
+	Applying commands to the rocket, from the keyboard or from the I/O
+	thread's queue. Every applied command is also written to the
+	recorder, stamped with the step it applies before, so a replay
+	feeds it to the same step.
+*/
+#pragma once
+
+#include <cstdint>
+#include "command_log.h"
+#include "io_thread.h"
+#include "simulation.h"
+
+typedef struct InputStats {
+    double lastLatencyMs;  // Port to rocket, for the latest queued command
+    double totalLatencyMs;
+    long commandsApplied;
+} InputStats;
+
+// Apply one command and record it. recorder may have no file open.
+void dispatch_command(Rocket *rocket, CommandRecorder *recorder, uint64_t step, int command);
+
+// Apply every command in the queue. Returns EXIT if it was sent (the
+// rest stay queued), otherwise the last command applied (NOP if none).
+int dispatch_queued_commands(CommandQueue *queue, Rocket *rocket, CommandRecorder *recorder, uint64_t step, InputStats *stats);
@@ -0,0 +1,175 @@
+#include "command_log.h"
+
+#define LOG_ERR "Cannot open command log %s\n"
+#define LOG_FORMAT_ERR "%s is not a command log (version %d)\n"
+
+static void put_u32(unsigned char *out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static void put_u64(unsigned char *out, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint32_t get_u32(const unsigned char *in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= (uint32_t)in[i] << (8 * i);
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+static void write_header(FILE *file, const CommandLogHeader *header) {
+    unsigned char bytes[COMMAND_LOG_HEADER_SIZE];
+    put_u32(bytes + 0, header->magic);
+    put_u32(bytes + 4, header->version);
+    put_u32(bytes + 8, header->seed);
+    put_u32(bytes + 12, (uint32_t)header->width);
+    put_u32(bytes + 16, (uint32_t)header->height);
+    put_u32(bytes + 20, (uint32_t)header->meteorCount);
+    put_u64(bytes + 24, header->steps);
+    put_u64(bytes + 32, header->stateHash);
+    put_u32(bytes + 40, (uint32_t)header->spawn.waveInterval);
+    put_u32(bytes + 44, (uint32_t)header->spawn.waveSize);
+    put_u32(bytes + 48, (uint32_t)header->spawn.maxMeteors);
+    put_u32(bytes + 52, (uint32_t)header->spawn.lifetime);
+    put_u32(bytes + 56, header->spawn.destroyOnHit ? 1 : 0);
+    fseek(file, 0, SEEK_SET);
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+// The first COMMAND_LOG_V1_HEADER_SIZE bytes, common to both versions
+static void read_header(const unsigned char *bytes, CommandLogHeader *header) {
+    header->magic = get_u32(bytes + 0);
+    header->version = get_u32(bytes + 4);
+    header->seed = get_u32(bytes + 8);
+    header->width = (int32_t)get_u32(bytes + 12);
+    header->height = (int32_t)get_u32(bytes + 16);
+    header->meteorCount = (int32_t)get_u32(bytes + 20);
+    header->steps = get_u64(bytes + 24);
+    header->stateHash = get_u64(bytes + 32);
+    header->spawn = MeteorSpawn{};
+}
+
+static void read_spawn(const unsigned char *bytes, MeteorSpawn *spawn) {
+    spawn->waveInterval = (int32_t)get_u32(bytes + 40);
+    spawn->waveSize = (int32_t)get_u32(bytes + 44);
+    spawn->maxMeteors = (int32_t)get_u32(bytes + 48);
+    spawn->lifetime = (int32_t)get_u32(bytes + 52);
+    spawn->destroyOnHit = (get_u32(bytes + 56) & 1) != 0;
+}
+
+int open_command_recording(CommandRecorder *recorder, const char *path, uint32_t seed,
+                           int width, int height, int meteorCount, const MeteorSpawn *spawn) {
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        fprintf(stderr, LOG_ERR, path);
+        return -1;
+    }
+    recorder->header = CommandLogHeader{ COMMAND_LOG_MAGIC, COMMAND_LOG_VERSION, seed, width, height, meteorCount, 0, 0, *spawn };
+    recorder->lastFrame = 0;
+    // Steps and hash are filled in by close_command_recording
+    write_header(recorder->file, &recorder->header);
+    return 0;
+}
+
+void record_command(CommandRecorder *recorder, uint64_t frame, unsigned char command) {
+    if (recorder->file == NULL)
+        return;
+    uint64_t delta = frame - recorder->lastFrame;
+    recorder->lastFrame = frame;
+
+    // LEB128: 7 bits per byte, high bit set on all but the last byte
+    unsigned char entry[11];
+    int size = 0;
+    do {
+        unsigned char byte = delta & 0x7F;
+        delta >>= 7;
+        entry[size++] = delta != 0 ? (byte | 0x80) : byte;
+    } while (delta != 0);
+    entry[size++] = command;
+    fwrite(entry, 1, size, recorder->file);
+}
+
+void close_command_recording(CommandRecorder *recorder, uint64_t steps, uint64_t stateHash) {
+    if (recorder->file == NULL)
+        return;
+    recorder->header.steps = steps;
+    recorder->header.stateHash = stateHash;
+    write_header(recorder->file, &recorder->header);
+    fclose(recorder->file);
+    recorder->file = NULL;
+}
+
+// Decode the frame delta at log->offset and leave offset on the command byte
+static void decode_next_frame(CommandLog *log) {
+    uint64_t delta = 0;
+    int shift = 0;
+    while (log->offset < log->entries.size()) {
+        unsigned char byte = log->entries[log->offset++];
+        delta |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0 || shift >= 64)
+            break;
+    }
+    log->nextFrame += delta;
+}
+
+int load_command_log(CommandLog *log, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, LOG_ERR, path);
+        return -1;
+    }
+    unsigned char header[COMMAND_LOG_HEADER_SIZE] = {};
+    // A truncated file is rejected before anything is decoded from it
+    if (fread(header, 1, COMMAND_LOG_V1_HEADER_SIZE, file) != COMMAND_LOG_V1_HEADER_SIZE) {
+        fprintf(stderr, LOG_FORMAT_ERR, path, 0);
+        fclose(file);
+        return -1;
+    }
+    read_header(header, &log->header);
+    bool valid = log->header.magic == COMMAND_LOG_MAGIC
+        && (log->header.version == 1 || log->header.version == COMMAND_LOG_VERSION);
+    if (valid && log->header.version == COMMAND_LOG_VERSION) {
+        const size_t rest = COMMAND_LOG_HEADER_SIZE - COMMAND_LOG_V1_HEADER_SIZE;
+        valid = fread(header + COMMAND_LOG_V1_HEADER_SIZE, 1, rest, file) == rest;
+        if (valid)
+            read_spawn(header, &log->header.spawn);
+    }
+    if (!valid) {
+        fprintf(stderr, LOG_FORMAT_ERR, path, (int)log->header.version);
+        fclose(file);
+        return -1;
+    }
+
+    log->entries.clear();
+    unsigned char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        log->entries.insert(log->entries.end(), buffer, buffer + count);
+    fclose(file);
+
+    log->offset = 0;
+    log->nextFrame = 0;
+    if (!log->entries.empty())
+        decode_next_frame(log);
+    return 0;
+}
+
+bool next_logged_command(CommandLog *log, uint64_t frame, unsigned char *command) {
+    if (log->offset >= log->entries.size() || log->nextFrame != frame)
+        return false;
+    *command = log->entries[log->offset++];
+    if (log->offset < log->entries.size())
+        decode_next_frame(log);
+    return true;
+}
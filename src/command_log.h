@@ -0,0 +1,64 @@
+/*
+	Binary recording of every command applied to the rocket, for
+	replaying a session headless without the emulator.
+
+	Layout (all integers little endian):
+		header   COMMAND_LOG_HEADER_SIZE bytes, see CommandLogHeader
+		entries  until end of file, one per applied command:
+		         frame delta (unsigned LEB128) + command byte
+	The frame delta is the number of simulation steps since the
+	previous entry, so a command every frame costs two bytes. The
+	header stores the seed given to init_simulation, which seeds the
+	simulation's own SimRandom, and after the session the number of
+	steps run and the simulation_hash of the final state. Version 2 adds the meteor
+	churn settings, version 1 logs load with churn off.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "meteor_pool.h"
+
+#define COMMAND_LOG_MAGIC 0x474F4C52 // "RLOG"
+#define COMMAND_LOG_VERSION 2
+#define COMMAND_LOG_V1_HEADER_SIZE 40
+#define COMMAND_LOG_HEADER_SIZE 60
+
+typedef struct CommandLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seed;
+    int32_t width;
+    int32_t height;
+    int32_t meteorCount;
+    uint64_t steps;     // Simulation steps in the session
+    uint64_t stateHash; // simulation_hash after the last step
+    MeteorSpawn spawn;  // Zero in version 1 logs
+} CommandLogHeader;
+
+typedef struct CommandRecorder {
+    FILE *file;
+    CommandLogHeader header;
+    uint64_t lastFrame;
+} CommandRecorder;
+
+typedef struct CommandLog {
+    CommandLogHeader header;
+    std::vector<unsigned char> entries;
+    size_t offset;      // Next entry to decode
+    uint64_t nextFrame; // Frame of the entry at offset
+} CommandLog;
+
+// Create path and write a header for a session. Returns 0 on success.
+int open_command_recording(CommandRecorder *recorder, const char *path, uint32_t seed,
+                           int width, int height, int meteorCount, const MeteorSpawn *spawn);
+// Log command as applied before simulation step `frame`. Frames must not decrease.
+void record_command(CommandRecorder *recorder, uint64_t frame, unsigned char command);
+// Fill in the step count and final hash and close the file
+void close_command_recording(CommandRecorder *recorder, uint64_t steps, uint64_t stateHash);
+
+// Read a whole log into memory. Returns 0 on success.
+int load_command_log(CommandLog *log, const char *path);
+// Next command logged for `frame`, false once all commands for it were read
+bool next_logged_command(CommandLog *log, uint64_t frame, unsigned char *command);
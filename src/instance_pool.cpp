@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include "instance_pool.h"
+
+// Instances handed to a job at a time. A step of a small field takes
+// about as long as queueing a job, so do a few per job.
+#define INSTANCES_PER_JOB 4
+
+static int open_instance_device(SimInstance *instance, const char *deviceDir, int index) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/" INSTANCE_DEVICE_NAME, deviceDir, index);
+    // The emulator may not have created it yet, wait for READY in an empty file
+    FILE *fp = fopen(path, "ab");
+    if (fp == NULL) {
+        fprintf(stderr, FILE_ERR, path);
+        return -1;
+    }
+    fclose(fp);
+    if (open_virtual_device(&instance->ownDevice, path) != 0)
+        return -1;
+    instance->device = &instance->ownDevice;
+    return 0;
+}
+
+int init_instance_pool(InstancePool *pool, int count, int width, int height, int meteorCount, uint32_t seed,
+                       InstancePorts ports, const char *deviceDir, long portStride, JobSystem *jobs) {
+    pool->ports = ports;
+    pool->sharedDevice = VirtualDevice{};
+    pool->jobs = jobs;
+    pool->maxSteps = 0;
+    // Sized once, instances point into their own ownDevice
+    pool->instances.clear();
+    pool->instances.resize(count);
+
+    if (ports == INSTANCE_PORTS_RANGE) {
+        if (portStride < PROTOCOL_PORT_COUNT)
+            portStride = PROTOCOL_PORT_COUNT;
+        // Threads poll different ranges at once, which stdio can't do
+        size_t size = std::max<size_t>(IO_MAP_SIZE, count * portStride);
+        if (open_virtual_device(&pool->sharedDevice, nullptr, IO_TRANSPORT_MMAP, size) != 0)
+            return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        SimInstance *instance = &pool->instances[i];
+        instance->seed = seed + (uint32_t)i;
+        init_simulation(&instance->sim, width, height, meteorCount, instance->seed);
+        // The pool's threads are spread over instances, not over meteors
+        instance->sim.jobs = nullptr;
+        instance->sim.deterministic = true;
+
+        if (ports == INSTANCE_PORTS_DEVICE_FILE && open_instance_device(instance, deviceDir, i) != 0) {
+            free_instance_pool(pool);
+            return -1;
+        }
+        if (ports == INSTANCE_PORTS_RANGE) {
+            instance->device = &pool->sharedDevice;
+            instance->portBase = i * portStride;
+        }
+    }
+    return 0;
+}
+
+static void finish_instance(SimInstance *instance) {
+    // Leave the ports ready for the next program, as stop_io_thread does
+    if (instance->connected)
+        free_port_protocol(&instance->protocol);
+    instance->connected = false;
+    instance->exited = true;
+}
+
+void free_instance_pool(InstancePool *pool) {
+    for (SimInstance &instance : pool->instances) {
+        if (instance.connected)
+            free_port_protocol(&instance.protocol);
+        if (instance.device == &instance.ownDevice)
+            close_virtual_device(&instance.ownDevice);
+        free_simulation(&instance.sim);
+    }
+    pool->instances.clear();
+    if (pool->ports == INSTANCE_PORTS_RANGE && pool->sharedDevice.ports != NULL)
+        close_virtual_device(&pool->sharedDevice);
+}
+
+// Returns true if the instance was stepped
+static bool step_instance(InstancePool *pool, SimInstance *instance) {
+    if (instance->exited)
+        return false;
+
+    if (instance->device != nullptr) {
+        if (!instance->connected) {
+            if (!port_program_ready(instance->device, instance->portBase))
+                return false;
+            init_port_protocol(&instance->protocol, instance->device, instance->portBase);
+            instance->protocol.readyWindowUs = INSTANCE_LEGACY_READY_US;
+            instance->connected = true;
+        }
+        unsigned char commands[RING_SIZE];
+        int count = receive_port_commands(&instance->protocol, commands, RING_SIZE);
+        for (int i = 0; i < count; i++) {
+            instance->commandsApplied++;
+            if (commands[i] == Command::EXIT) {
+                finish_instance(instance);
+                return false;
+            }
+            apply_command(&instance->sim.rocket, commands[i]);
+            if (commands[i] != Command::NOP)
+                instance->lastCommand = commands[i];
+        }
+    }
+
+    step_simulation(&instance->sim);
+    instance->steps++;
+    if (instance->connected) {
+        update_telemetry(&instance->telemetry, &instance->sim);
+        publish_telemetry(&instance->telemetry, instance->device, instance->portBase);
+    }
+    if (pool->maxSteps != 0 && instance->steps >= pool->maxSteps)
+        finish_instance(instance);
+    return true;
+}
+
+int step_instance_pool(InstancePool *pool) {
+    std::atomic<int> stepped{0};
+    parallel_for(pool->jobs, (int)pool->instances.size(), INSTANCES_PER_JOB, [&](int begin, int end) {
+        int count = 0;
+        for (int i = begin; i < end; i++)
+            count += step_instance(pool, &pool->instances[i]) ? 1 : 0;
+        stepped.fetch_add(count, std::memory_order_relaxed);
+    });
+    return stepped.load(std::memory_order_relaxed);
+}
+
+int running_instances(const InstancePool *pool) {
+    int count = 0;
+    for (const SimInstance &instance : pool->instances)
+        count += instance.exited ? 0 : 1;
+    return count;
+}
@@ -0,0 +1,82 @@
+/*
+	Many independent simulations in one process, for grading or stress
+	testing lots of 8086 programs at once without a process, window and
+	GL context each.
+
+	Every instance has its own Simulation (rocket, meteor field, random
+	state seeded with seed + index) and its own ports, either a device
+	file of its own or a port range of one shared device file. Instance
+	i of a shared file uses the ports at i * portStride, so the program
+	of instance 0 runs unchanged.
+
+	step_instance_pool advances every instance by one step. Instances
+	are spread over the job pool and each is stepped serially on the
+	thread that picked it up, so the meteor kernels stay SIMD but no
+	instance waits on another one's threads. Ports are polled in the
+	same pass: with mmap a poll is a load, cheaper than a thread per
+	instance. Because a single instance never runs on more than one
+	thread, the results do not depend on the thread count. Telemetry is
+	published in the same pass, right after an instance's step.
+
+	A legacy (version 1) program only sees COMMAND_READY while its
+	instance polls, so each poll shows it for up to
+	INSTANCE_LEGACY_READY_US, as the I/O thread does. That holds the
+	instance's thread for as long unless a command arrives first.
+*/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "job_system.h"
+#include "port_protocol.h"
+#include "simulation.h"
+#include "telemetry.h"
+#include "virtual.h"
+
+#define INSTANCE_DEVICE_NAME "emu8086_%d.io" // In the device directory, %d is the index
+#define INSTANCE_LEGACY_READY_US 1000 // How long a poll shows COMMAND_READY to a legacy program
+
+enum InstancePorts {
+    INSTANCE_PORTS_NONE,        // No emulator, instances step freely
+    INSTANCE_PORTS_DEVICE_FILE, // One device file per instance
+    INSTANCE_PORTS_RANGE,       // Port ranges of the shared device file
+};
+
+typedef struct SimInstance {
+    Simulation sim;
+    uint32_t seed;
+    VirtualDevice ownDevice; // INSTANCE_PORTS_DEVICE_FILE only
+    VirtualDevice *device;   // Ports of this instance, null without ports
+    long portBase;
+    PortProtocol protocol;
+    Telemetry telemetry;
+    bool connected;          // READY seen
+    bool exited;             // EXIT received or step limit reached
+    uint64_t steps;
+    long commandsApplied;
+    int lastCommand;         // Last command other than NOP
+} SimInstance;
+
+typedef struct InstancePool {
+    std::vector<SimInstance> instances;
+    InstancePorts ports;
+    VirtualDevice sharedDevice; // INSTANCE_PORTS_RANGE only
+    JobSystem *jobs;
+    uint64_t maxSteps;          // Per instance, 0 runs until EXIT
+} InstancePool;
+
+// Create count instances. deviceDir is used with INSTANCE_PORTS_DEVICE_FILE,
+// missing device files are created. portStride is used with
+// INSTANCE_PORTS_RANGE and is at least PROTOCOL_PORT_COUNT. Returns
+// non-zero if a device could not be opened.
+int init_instance_pool(InstancePool *pool, int count, int width, int height, int meteorCount, uint32_t seed,
+                       InstancePorts ports, const char *deviceDir, long portStride, JobSystem *jobs);
+// Reset the ports of instances that are still connected and close the devices
+void free_instance_pool(InstancePool *pool);
+
+// Poll the ports and step every instance that is not waiting for READY
+// or done. Returns how many instances were stepped.
+int step_instance_pool(InstancePool *pool);
+
+// Instances that have not exited yet
+int running_instances(const InstancePool *pool);
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include "io_thread.h"
+#include "virtual.h"
+
+#if defined(__linux__)
+    #include <poll.h>
+    #include <sys/eventfd.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+static void open_change_watch(IoThread *io, const char *path) {
+#if defined(__linux__)
+    // Without the eventfd nothing could cut a poll short, so the timed
+    // wait on the condition variable is used instead of inotify
+    io->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (io->wakeFd < 0)
+        return;
+    io->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (io->inotifyFd < 0)
+        return;
+    if (inotify_add_watch(io->inotifyFd, path, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(io->inotifyFd);
+        io->inotifyFd = -1;
+    }
+#else
+    (void)io;
+    (void)path;
+#endif
+}
+
+static void close_change_watch(IoThread *io) {
+#if defined(__linux__)
+    if (io->inotifyFd >= 0)
+        close(io->inotifyFd);
+    if (io->wakeFd >= 0)
+        close(io->wakeFd);
+#endif
+    io->inotifyFd = -1;
+    io->wakeFd = -1;
+}
+
+// Drop the queued change events. Returns true if there were any.
+static bool drain_change_events(IoThread *io) {
+    bool drained = false;
+#if defined(__linux__)
+    // Only the wake-up matters, not the events themselves
+    char events[4096];
+    while (io->inotifyFd >= 0 && read(io->inotifyFd, events, sizeof(events)) > 0)
+        drained = true;
+#else
+    (void)io;
+#endif
+    return drained;
+}
+
+// Our own port writes modify the I/O file too. Push them out of the
+// FILE buffer and drop the events they caused, so wait_for_change only
+// wakes up for the program. A write by the program in between is
+// dropped with them, the poll timeout still picks it up.
+static void ignore_own_changes(IoThread *io) {
+    if (io->inotifyFd < 0)
+        return;
+    if (io->protocol.device->file != NULL)
+        fflush(io->protocol.device->file);
+    drain_change_events(io);
+}
+
+// Sleep until the I/O file changes, a telemetry frame is pending or
+// timeoutMs passes. Returns true if a change to the file woke us up.
+static bool wait_for_change(IoThread *io, int timeoutMs) {
+#if defined(__linux__)
+    if (io->wakeFd >= 0) {
+        // poll skips the inotify entry if there is no watch
+        struct pollfd fds[2] = { { io->inotifyFd, POLLIN, 0 }, { io->wakeFd, POLLIN, 0 } };
+        if (poll(fds, 2, timeoutMs) <= 0)
+            return false;
+        if (fds[1].revents & POLLIN) {
+            uint64_t wakeups;
+            (void)!read(io->wakeFd, &wakeups, sizeof(wakeups));
+        }
+        return (fds[0].revents & POLLIN) != 0 && drain_change_events(io);
+    }
+#endif
+    std::unique_lock<std::mutex> lock(io->telemetryMutex);
+    // stop_io_thread wakes us as well, or shutdown would wait out the timeout
+    io->telemetryWake.wait_for(lock, std::chrono::milliseconds(timeoutMs), [io] {
+        return io->telemetryPending || !io->running.load(std::memory_order_acquire);
+    });
+    return false;
+}
+
+// Cut a wait_for_change short
+static void wake_io_thread(IoThread *io) {
+#if defined(__linux__)
+    if (io->wakeFd >= 0) {
+        uint64_t one = 1;
+        (void)!write(io->wakeFd, &one, sizeof(one));
+        return;
+    }
+#endif
+    io->telemetryWake.notify_one();
+}
+
+static void set_connected(IoThread *io, bool connected) {
+    {
+        std::lock_guard<std::mutex> lock(io->connectedMutex);
+        io->connected.store(connected, std::memory_order_release);
+    }
+    io->connectedChanged.notify_all();
+}
+
+// Move everything the program queued into io->commands. Returns how many
+// commands were moved.
+static int forward_commands(IoThread *io) {
+    CommandQueue &queue = io->commands;
+    unsigned head = queue.head.load(std::memory_order_relaxed);
+    unsigned space = COMMAND_QUEUE_SIZE - (head - queue.tail.load(std::memory_order_acquire));
+
+    unsigned char received[RING_SIZE];
+    int count = receive_port_commands(&io->protocol, received, std::min<int>(space, RING_SIZE));
+    if (count == 0)
+        return 0;
+    IoClock::time_point now = IoClock::now();
+    for (int i = 0; i < count; i++)
+        queue.commands[(head + i) % COMMAND_QUEUE_SIZE] = TimedCommand{ received[i], now };
+    queue.head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+// Write the frame publish_io_telemetry left for us, stdio devices only
+static void flush_telemetry(IoThread *io) {
+    std::lock_guard<std::mutex> lock(io->telemetryMutex);
+    if (!io->telemetryPending)
+        return;
+    publish_telemetry(&io->telemetry, io->protocol.device, io->protocol.portBase);
+    io->telemetryPending = false;
+}
+
+static void io_thread_main(IoThread *io) {
+    const int maxTimeoutMs = io->inotifyFd >= 0 ? IO_POLL_MAX_INOTIFY_MS : IO_POLL_MAX_MS;
+    int timeoutMs = IO_POLL_MIN_MS;
+
+    // Wait for the emulator, sleeping instead of spinning on the port
+    while (io->running.load(std::memory_order_acquire)) {
+        int statusByte = read_port_byte(STATUS_PORT);
+        if (statusByte == Status::READY) {
+            init_port_protocol(&io->protocol);
+            io->protocol.readyWindowUs = IO_LEGACY_READY_US;
+            io->protocolVersion.store(io->protocol.version, std::memory_order_relaxed);
+            printf("Port Value: %d\n", statusByte);
+            printf("Command protocol: v%d %s\n", io->protocol.version,
+                   io->protocol.version == PROTOCOL_VERSION_RING ? "(ring)" : "(one command at a time)");
+            set_connected(io, true);
+            break;
+        }
+        timeoutMs = wait_for_change(io, timeoutMs) ? IO_POLL_MIN_MS : std::min(timeoutMs * 2, maxTimeoutMs);
+    }
+
+    // A legacy program only sees COMMAND_READY while we poll, so poll at
+    // least once a frame instead of backing off to the inotify maximum
+    const int connectedMaxMs = io->protocol.version == PROTOCOL_VERSION_LEGACY ? IO_POLL_MAX_MS : maxTimeoutMs;
+    timeoutMs = IO_POLL_MIN_MS;
+    while (io->running.load(std::memory_order_acquire)) {
+        flush_telemetry(io);
+        if (forward_commands(io) > 0) {
+            // More may follow right behind, look again straight away
+            timeoutMs = IO_POLL_MIN_MS;
+            continue;
+        }
+        ignore_own_changes(io);
+        timeoutMs = wait_for_change(io, timeoutMs) ? IO_POLL_MIN_MS : std::min(timeoutMs * 2, connectedMaxMs);
+    }
+
+    // Leave the ports in a clean state for the next run
+    if (io->connected.load(std::memory_order_acquire))
+        free_port_protocol(&io->protocol);
+    free_virtual_device();
+}
+
+int start_io_thread(IoThread *io, const char *path) {
+    if (path == nullptr)
+        path = virtual_device_path();
+    if (init_virtual_device(path) != 0)
+        return -1;
+
+    open_change_watch(io, path);
+    io->running.store(true, std::memory_order_release);
+    io->thread = std::thread(io_thread_main, io);
+    return 0;
+}
+
+void stop_io_thread(IoThread *io) {
+    if (!io->thread.joinable())
+        return;
+    {
+        // Both locks, so neither wait can miss the change
+        std::lock_guard<std::mutex> lock(io->connectedMutex);
+        std::lock_guard<std::mutex> telemetryLock(io->telemetryMutex);
+        io->running.store(false, std::memory_order_release);
+    }
+    io->connectedChanged.notify_all();
+    wake_io_thread(io);
+    io->thread.join();
+    close_change_watch(io);
+    set_connected(io, false);
+}
+
+bool wait_for_io_connection(IoThread *io, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(io->connectedMutex);
+    auto settled = [io] {
+        return io->connected.load(std::memory_order_acquire) || !io->running.load(std::memory_order_acquire);
+    };
+    if (timeoutMs < 0)
+        io->connectedChanged.wait(lock, settled);
+    else
+        io->connectedChanged.wait_for(lock, std::chrono::milliseconds(timeoutMs), settled);
+    return io->connected.load(std::memory_order_acquire);
+}
+
+void publish_io_telemetry(IoThread *io, const Simulation *sim) {
+    if (!io->connected.load(std::memory_order_acquire))
+        return;
+    if (io->protocol.device->ports != NULL) {
+        // Telemetry ports are written by nobody else, no need for the lock
+        update_telemetry(&io->telemetry, sim);
+        publish_telemetry(&io->telemetry, io->protocol.device, io->protocol.portBase);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(io->telemetryMutex);
+        update_telemetry(&io->telemetry, sim);
+        io->telemetryPending = true;
+    }
+    wake_io_thread(io);
+}
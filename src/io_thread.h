@@ -0,0 +1,91 @@
+/*
+	Thread that owns the virtual device. It waits for the emulator to
+	send READY, then moves commands from the ports into a lock-free
+	single-producer/single-consumer queue, stamped with the time they
+	arrived. The render loop only pops from that queue, so it never
+	touches the I/O file or waits on it.
+
+	Between polls the thread sleeps on inotify events for the I/O file
+	(Linux) with a timeout that doubles while nothing happens, from
+	IO_POLL_MIN_MS up to the max. The timeout also covers writers that
+	inotify cannot see, such as another process writing through mmap.
+	Events from the thread's own port writes are dropped before it
+	sleeps, so only the program can cut the backoff short.
+
+	Telemetry goes out through publish_io_telemetry. With a mapped device
+	the caller writes it straight into the mapping. Through stdio the
+	FILE belongs to this thread, so the caller leaves the newest frame
+	here and wakes the thread to write it: through an eventfd polled
+	next to the inotify fd on Linux, a condition variable otherwise.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "port_protocol.h"
+#include "simulation.h"
+#include "telemetry.h"
+
+#define COMMAND_QUEUE_SIZE 256 // Power of two
+#define IO_POLL_MIN_MS 1
+#define IO_POLL_MAX_MS 16          // Without inotify, or for a legacy program
+#define IO_POLL_MAX_INOTIFY_MS 100 // With inotify, events wake us earlier
+#define IO_LEGACY_READY_US 1000    // How long a poll shows COMMAND_READY to a legacy program
+
+typedef std::chrono::steady_clock IoClock;
+
+typedef struct TimedCommand {
+    unsigned char command;
+    IoClock::time_point arrival; // When the I/O thread read it from the port
+} TimedCommand;
+
+typedef struct CommandQueue {
+    TimedCommand commands[COMMAND_QUEUE_SIZE];
+    alignas(64) std::atomic<unsigned> head{0}; // Written by the I/O thread only
+    alignas(64) std::atomic<unsigned> tail{0}; // Written by the consumer only
+} CommandQueue;
+
+typedef struct IoThread {
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> connected{false}; // READY seen, commands are flowing
+    std::atomic<int> protocolVersion{0};
+    std::mutex connectedMutex;
+    std::condition_variable connectedChanged;
+    PortProtocol protocol; // Only used by the I/O thread
+    CommandQueue commands;
+    Telemetry telemetry{};
+    std::mutex telemetryMutex; // Guards telemetry when the device is not mapped
+    std::condition_variable telemetryWake;
+    bool telemetryPending = false;
+    int inotifyFd = -1;
+    int wakeFd = -1;           // eventfd, written when a frame is pending
+} IoThread;
+
+// Open the virtual device (see init_virtual_device) and start the thread.
+// Returns non-zero without starting anything if the device can't be opened.
+int start_io_thread(IoThread *io, const char *path = nullptr);
+// Stop the thread, reset the ports and close the device
+void stop_io_thread(IoThread *io);
+
+// Block until the emulator sent READY, at most timeoutMs when it is not
+// negative. Returns false if the thread stopped or the time ran out.
+bool wait_for_io_connection(IoThread *io, int timeoutMs = -1);
+
+// Publish the state of sim as the next telemetry frame. Does nothing
+// until the emulator connected. Call from one thread only.
+void publish_io_telemetry(IoThread *io, const Simulation *sim);
+
+// Consumer side of the queue, call from one thread only
+inline bool pop_command(CommandQueue *commands, TimedCommand *command) {
+    CommandQueue &queue = *commands;
+    unsigned tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail == queue.head.load(std::memory_order_acquire))
+        return false;
+    *command = queue.commands[tail % COMMAND_QUEUE_SIZE];
+    queue.tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,124 @@
+#include "job_system.h"
+
+// Queue owned by the current thread. Threads outside the pool share 0.
+static thread_local int currentQueue = 0;
+
+static bool push_job(JobSystem *jobs, int queueIndex, const Job &job) {
+    JobQueue &queue = jobs->queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size == JOB_QUEUE_CAPACITY)
+        return false;
+    queue.jobs[(queue.head + queue.size) % JOB_QUEUE_CAPACITY] = job;
+    queue.size++;
+    jobs->queuedJobs.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+// Newest job from our own queue first, then the oldest job of any other
+static bool take_job(JobSystem *jobs, int queueIndex, Job *job) {
+    {
+        JobQueue &queue = jobs->queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.size > 0) {
+            queue.size--;
+            *job = queue.jobs[(queue.head + queue.size) % JOB_QUEUE_CAPACITY];
+            jobs->queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (int offset = 1; offset < jobs->threadCount; offset++) {
+        JobQueue &victim = jobs->queues[(queueIndex + offset) % jobs->threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.size > 0) {
+            *job = victim.jobs[victim.head];
+            victim.head = (victim.head + 1) % JOB_QUEUE_CAPACITY;
+            victim.size--;
+            jobs->queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void execute_job(const Job &job) {
+    job.function(job.context, job.begin, job.end);
+    job.pending->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+static void worker_main(JobSystem *jobs, int queueIndex) {
+    currentQueue = queueIndex;
+    Job job;
+    while (jobs->running.load(std::memory_order_acquire)) {
+        if (take_job(jobs, queueIndex, &job)) {
+            execute_job(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(jobs->sleepMutex);
+        jobs->wake.wait(lock, [jobs] {
+            return jobs->queuedJobs.load(std::memory_order_acquire) > 0 || !jobs->running.load(std::memory_order_acquire);
+        });
+    }
+}
+
+void init_job_system(JobSystem *jobs, int threadCount) {
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    jobs->threadCount = threadCount;
+    jobs->queues.reset(new JobQueue[threadCount]);
+    jobs->running.store(true, std::memory_order_release);
+    for (int i = 1; i < threadCount; i++)
+        jobs->workers.emplace_back(worker_main, jobs, i);
+}
+
+void free_job_system(JobSystem *jobs) {
+    {
+        std::lock_guard<std::mutex> lock(jobs->sleepMutex);
+        jobs->running.store(false, std::memory_order_release);
+    }
+    jobs->wake.notify_all();
+    for (std::thread &worker : jobs->workers)
+        worker.join();
+    jobs->workers.clear();
+    jobs->queues.reset();
+    jobs->threadCount = 1;
+}
+
+void run_parallel(JobSystem *jobs, int count, int grain, JobFunction function, void *context) {
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+    if (jobs == nullptr || jobs->threadCount <= 1 || count <= grain) {
+        function(context, 0, count);
+        return;
+    }
+
+    const int chunks = (count + grain - 1) / grain;
+    std::atomic<int> pending(chunks);
+    const int self = currentQueue;
+
+    // Deal chunks round-robin so every worker starts with local work
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        int begin = chunk * grain;
+        int end = begin + grain < count ? begin + grain : count;
+        Job job = { function, context, begin, end, &pending };
+        if (!push_job(jobs, (self + chunk) % jobs->threadCount, job))
+            execute_job(job);
+    }
+    {
+        std::lock_guard<std::mutex> lock(jobs->sleepMutex);
+    }
+    jobs->wake.notify_all();
+
+    // Help out until our chunks are done (possibly by other threads)
+    Job job;
+    while (pending.load(std::memory_order_acquire) > 0) {
+        if (take_job(jobs, self, &job))
+            execute_job(job);
+        else
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,61 @@
+/*
+	Small work-stealing thread pool. Every thread (the workers plus
+	whoever calls parallel_for) owns a fixed-size job queue: the owner
+	pops its newest job, idle threads steal the oldest job from other
+	queues. parallel_for spreads chunks over all queues and the caller
+	helps until every chunk is done, so calls may nest.
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define JOB_QUEUE_CAPACITY 1024
+
+typedef void (*JobFunction)(void *context, int begin, int end);
+
+typedef struct Job {
+    JobFunction function;
+    void *context;
+    int begin;
+    int end;
+    std::atomic<int> *pending;
+} Job;
+
+typedef struct JobQueue {
+    std::mutex mutex;
+    Job jobs[JOB_QUEUE_CAPACITY];
+    int head = 0; // Oldest job, thieves take from here
+    int size = 0;
+} JobQueue;
+
+typedef struct JobSystem {
+    int threadCount = 1; // Worker threads + the calling thread
+    std::vector<std::thread> workers;
+    std::unique_ptr<JobQueue[]> queues;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> queuedJobs{0};
+    std::atomic<bool> running{false};
+} JobSystem;
+
+// Start threadCount - 1 workers. 0 uses one thread per hardware thread.
+void init_job_system(JobSystem *jobs, int threadCount = 0);
+void free_job_system(JobSystem *jobs);
+
+// Call function(context, begin, end) over [0, count) in chunks of grain
+// and return when all chunks have run. Runs inline when jobs is null.
+void run_parallel(JobSystem *jobs, int count, int grain, JobFunction function, void *context);
+
+template <typename Body>
+void parallel_for(JobSystem *jobs, int count, int grain, Body &&body) {
+    using BodyType = std::remove_reference_t<Body>;
+    run_parallel(jobs, count, grain, [](void *context, int begin, int end) {
+        (*static_cast<BodyType *>(context))(begin, end);
+    }, (void *)&body);
+}
@@ -1,55 +1,38 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <sstream>
+#include <vector>
 #include <raylib.h>
 #include <raymath.h>
+#include "asset_pack.h"
+#include "background.h"
+#include "command_dispatch.h"
+#include "command_log.h"
+#include "instance_pool.h"
+#include "io_thread.h"
+#include "meteor_renderer.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "text_layer.h"
 #include "virtual.h"
 
-#define ROCKET_SPEED 6.0f
-#define ROCKET_ROTATION_SPEED 3.0f
-#define ROCKET_ACCELRATION 0.02f
-
-#define METEOR_SPEED 0.5f
-#define METEOR_ANGULAR_SPEED 0.5f
-#define METEOR_DEACCEL 0.0003f
-#define MAX_METEORS 15
-#define METEOR_COLLISION_DAMPING 0.0001f
-#define METEOR_ROCKET_COLLISION_DAMPING 0.1f;
-
-#define COMMAND_PORT 10
-#define STATUS_PORT  11
-
-#define DEFAULT_FONT_SIZE 20
-
-typedef struct Rocket {
-    Vector2 position;
-    Vector2 velocity;
-    float rotation;
-    float acceleration;
-} Rocket;
-
-typedef struct Meteor {
-    Vector2 position;
-    Vector2 velocity;
-    float   radius;   // Scale factor of texture (1.0 default)
-} Meteor;
-
-enum Status {
-    NOT_READY = 0,
-    READY = 69,             // Initial ready set by the emulator   
-    COMMAND_NOT_READY = 99, // Not ready to execute the next command (check from asm before setting command)
-    COMMAND_READY = 100,    // Ready to execute the next command
-};
-
-// Commands to control rocket from virtual port
-enum Command {
-    NOP,
-    ACCEL_POS,    // Acceleration increases by ROCKET_ACCELERATION
-    ACCEL_NEG,
-    ROTATE_RIGHT, // Rotation factor is ROCKET_ROTATION_SPEED
-    ROTATE_LEFT,
-    EXIT          // Sent when emulator wants to shutdown the device
-};
-
+#define DEFAULT_FONT_SIZE FONT_SIZE_SMALL
+#define TARGET_FPS 60
+// Text layer sizes, each covers the text drawn into it
+#define HUD_LAYER_WIDTH 440
+#define METEOR_PANEL_WIDTH 500
+#define METEOR_PANEL_HEIGHT 70
+#define METEOR_LABEL_WIDTH 120
+
+// Steps run by --headless when no --steps is given and no emulator is attached
+#define HEADLESS_DEFAULT_STEPS 100000
+// How long --headless waits for the emulator's READY before giving up
+#define HEADLESS_CONNECT_TIMEOUT_MS 30000
+// Frames rendered per meteor path by --render-bench
+#define RENDER_BENCH_FRAMES 300
 
 char *command_str_map[6] = {
     "Command::NOP",
@@ -61,140 +44,462 @@ char *command_str_map[6] = {
 };
 
 bool portAccessAvailable = false;
+IoThread io;
+
+// Time from a command being read off the port to it being applied
+InputStats inputStats = {};
+
+Simulation sim = {};
+JobSystem jobs;
+
+// Steps run so far, the frame index of recorded commands
+uint64_t simulationStep = 0;
+CommandRecorder recorder = {};
+
+// --instances: many simulations stepped together, one of them is shown
+bool batchMode = false;
+InstancePool pool;
+int shownInstance = 0;
+
+// Meteor clicked for debug info, its handle survives other meteors
+// despawning. The index is looked up again every frame, -1 when the
+// meteor is gone or nothing is selected.
+MeteorHandle selectedMeteor = NULL_METEOR_HANDLE;
+int currentSelectedMeteorDebug = -1;
+
+// Apply a port or keyboard command, logging it when --record is given
+static void apply_input(Rocket *rocket, int command) {
+    dispatch_command(rocket, &recorder, simulationStep, command);
+}
+
+// Apply every command the I/O thread queued since the last call. Returns
+// EXIT if it was sent, otherwise the last command applied (NOP if none).
+static int process_port_commands(Rocket *rocket) {
+    return dispatch_queued_commands(&io.commands, rocket, &recorder, simulationStep, &inputStats);
+}
+
+static void free_port_access() {
+    if (!portAccessAvailable)
+        return;
+    stop_io_thread(&io);
+}
+
+// Step the physics with no window as fast as possible. Runs for `steps`
+// steps, or until the emulator sends EXIT when steps is 0.
+static void run_headless(long steps) {
+    if (steps == 0 && !portAccessAvailable)
+        steps = HEADLESS_DEFAULT_STEPS;
+    std::cout << "Meteor kernels: " << simd_level_name(active_simd_level()) << ", threads: " << jobs.threadCount
+              << (sim.deterministic ? " (deterministic)" : "") << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    long step = 0;
+    int command = Command::NOP;
+    while ((steps == 0 || step < steps) && command != Command::EXIT) {
+        if (portAccessAvailable)
+            command = process_port_commands(&sim.rocket);
+        if (command == Command::EXIT)
+            break;
+        step_simulation(&sim);
+        simulationStep++;
+        step++;
+        if (portAccessAvailable)
+            publish_io_telemetry(&io, &sim);
+        profile_end_frame();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double elapsed = std::chrono::duration<double>(end - start).count();
+    std::cout << "Headless: " << step << " steps (" << step * SIMULATION_TIMESTEP << "s simulated) in "
+              << elapsed << "s, " << (long)(step / (elapsed > 0 ? elapsed : 1e-9)) << " steps/s" << std::endl;
+    std::cout << "Rocket: " << sim.rocket.position.x << ", " << sim.rocket.position.y << std::endl;
+    if (inputStats.commandsApplied > 0)
+        std::cout << "Commands: " << inputStats.commandsApplied << ", average input latency "
+                  << inputStats.totalLatencyMs / inputStats.commandsApplied << " ms" << std::endl;
+#if defined(ROCKET_PROFILER)
+    for (ProfilePhase phase : { PHASE_COLLISION, PHASE_METEOR_UPDATE }) {
+        PhaseStats stats = profile_phase_stats(phase);
+        std::cout << profile_phase_name(phase) << ": p50 " << stats.p50Ms << " ms, p99 " << stats.p99Ms << " ms" << std::endl;
+    }
+#endif
+}
+
+// Step every instance with no window until all of them are done. Runs
+// for `steps` steps per instance, or until each emulator sends EXIT.
+// Returns non-zero if it gave up on emulators that never sent READY.
+static int run_batch_headless(long steps) {
+    pool.maxSteps = steps == 0 && pool.ports == INSTANCE_PORTS_NONE ? HEADLESS_DEFAULT_STEPS : steps;
+    std::cout << "Meteor kernels: " << simd_level_name(active_simd_level()) << ", threads: " << jobs.threadCount
+              << ", instances: " << pool.instances.size() << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    auto lastStep = start;
+    uint64_t totalSteps = 0;
+    int status = 0;
+    while (running_instances(&pool) > 0) {
+        int stepped = step_instance_pool(&pool);
+        totalSteps += stepped;
+        // Every instance left is waiting for its emulator
+        if (stepped == 0) {
+            if (std::chrono::steady_clock::now() - lastStep > std::chrono::milliseconds(HEADLESS_CONNECT_TIMEOUT_MS)) {
+                std::cerr << "No READY from " << running_instances(&pool) << " instances after "
+                          << HEADLESS_CONNECT_TIMEOUT_MS / 1000 << "s, giving up" << std::endl;
+                status = 1;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(IO_POLL_MIN_MS));
+        } else {
+            lastStep = std::chrono::steady_clock::now();
+        }
+        profile_end_frame();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double elapsed = std::chrono::duration<double>(end - start).count();
+    std::cout << "Batch: " << totalSteps << " steps over " << pool.instances.size() << " instances in "
+              << elapsed << "s, " << (long)(totalSteps / (elapsed > 0 ? elapsed : 1e-9)) << " steps/s" << std::endl;
+    for (size_t i = 0; i < pool.instances.size(); i++) {
+        const SimInstance &instance = pool.instances[i];
+        std::cout << "Instance " << i << ": seed " << instance.seed << ", steps " << instance.steps
+                  << ", commands " << instance.commandsApplied << ", rocket " << instance.sim.rocket.position.x
+                  << ", " << instance.sim.rocket.position.y << ", hash " << std::hex << simulation_hash(&instance.sim)
+                  << std::dec << std::endl;
+    }
+    return status;
+}
+
+// Connection state of the shown instance, for the HUD
+static const char *instance_state(const SimInstance *instance) {
+    if (instance->exited)
+        return "Exited";
+    if (instance->device == nullptr)
+        return "No ports";
+    return instance->connected ? "Connected" : "Waiting for READY";
+}
+
+// p50/p99 of every phase over the last PROFILE_HISTORY frames
+static void profiler_overlay_lines(TextLayer *layer, const Font *font, Vector2 position) {
+#if defined(ROCKET_PROFILER)
+    text_layer_line(layer, font, position, DEFAULT_FONT_SIZE, YELLOW, "Phase            p50 ms   p99 ms");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        PhaseStats stats = profile_phase_stats((ProfilePhase)phase);
+        position.y += DEFAULT_FONT_SIZE + 2;
+        text_layer_line(layer, font, position, DEFAULT_FONT_SIZE, YELLOW, "%-14s %8.3f %8.3f",
+                        profile_phase_name((ProfilePhase)phase), stats.p50Ms, stats.p99Ms);
+    }
+#else
+    (void)layer;
+    (void)font;
+    (void)position;
+#endif
+}
+
+// Re-run a recorded session and compare the final state with the hash
+// stored in the log. Returns true if they match.
+static bool run_replay(const char *path) {
+    CommandLog log;
+    if (load_command_log(&log, path) != 0)
+        return false;
+
+    Simulation replay = {};
+    init_simulation(&replay, log.header.width, log.header.height, log.header.meteorCount, log.header.seed);
+    set_meteor_spawn(&replay, &log.header.spawn);
+    replay.deterministic = true;
+
+    unsigned char command;
+    for (uint64_t step = 0; step < log.header.steps; step++) {
+        while (next_logged_command(&log, step, &command))
+            apply_command(&replay.rocket, command);
+        step_simulation(&replay);
+    }
+    // Commands read after the last step, such as EXIT
+    while (next_logged_command(&log, log.header.steps, &command))
+        apply_command(&replay.rocket, command);
+
+    bool matches = simulation_hash(&replay) == log.header.stateHash;
+    free_simulation(&replay);
+    return matches;
+}
+
+// Replay every log, several at once on the job pool. Returns the number
+// of logs that did not reproduce their recorded state.
+static int run_replays(const std::vector<const char *> &paths) {
+    std::vector<char> matches(paths.size(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+    parallel_for(&jobs, (int)paths.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            matches[i] = run_replay(paths[i]);
+    });
+    auto end = std::chrono::steady_clock::now();
+
+    int failures = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::cout << (matches[i] ? "PASS " : "FAIL ") << paths[i] << std::endl;
+        failures += matches[i] ? 0 : 1;
+    }
+    std::cout << "Replayed " << paths.size() << " logs in " << std::chrono::duration<double>(end - start).count()
+              << "s, " << failures << " failed" << std::endl;
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    const auto processStart = std::chrono::steady_clock::now();
+    const int width = SCREEN_WIDTH;
+    const int height = SCREEN_HEIGHT;
+
+    bool headless = false;
+    long headlessSteps = 0;
+    int meteorCount = DEFAULT_METEORS;
+    bool renderBench = false;
+    int threadCount = 0;
+    bool deterministic = false;
+    const char *recordPath = nullptr;
+    std::vector<const char *> replayPaths;
+    unsigned int seed = (unsigned int)time(NULL);
+    bool showProfiler = false;
+    const char *tracePath = nullptr;
+    float backgroundScale = BACKGROUND_DEFAULT_SCALE;
+    bool adaptiveBackground = true;
+    int instanceCount = 0;
+    InstancePorts instancePorts = INSTANCE_PORTS_NONE;
+    const char *deviceDir = nullptr;
+    long portStride = 0;
+    MeteorSpawn spawn = {};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            headlessSteps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--meteors") == 0 && i + 1 < argc) {
+            meteorCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render-bench") == 0) {
+            renderBench = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            deterministic = true;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            // May be given many times
+            replayPaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            showProfiler = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--bg-scale") == 0 && i + 1 < argc) {
+            // Fixed background resolution scale, or "auto" to follow frame time
+            const char *scale = argv[++i];
+            adaptiveBackground = strcmp(scale, "auto") == 0;
+            if (!adaptiveBackground)
+                backgroundScale = (float)atof(scale);
+        } else if (strcmp(argv[i], "--wave-interval") == 0 && i + 1 < argc) {
+            // Steps between meteor waves
+            spawn.waveInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--wave-size") == 0 && i + 1 < argc) {
+            spawn.waveSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--meteor-cap") == 0 && i + 1 < argc) {
+            spawn.maxMeteors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--meteor-lifetime") == 0 && i + 1 < argc) {
+            // Steps before a meteor despawns
+            spawn.lifetime = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--destroy-on-hit") == 0) {
+            spawn.destroyOnHit = true;
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instanceCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--device-dir") == 0 && i + 1 < argc) {
+            // Instance i talks to DIR/emu8086_<i>.io
+            deviceDir = argv[++i];
+            instancePorts = INSTANCE_PORTS_DEVICE_FILE;
+        } else if (strcmp(argv[i], "--port-stride") == 0 && i + 1 < argc) {
+            // Instance i uses the ports at i * N of the usual device file
+            portStride = atol(argv[++i]);
+            instancePorts = INSTANCE_PORTS_RANGE;
+        } else if (strcmp(argv[i], "--show") == 0 && i + 1 < argc) {
+            shownInstance = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            // Force a lower kernel level (scalar, sse2, avx) for comparison
+            const char *level = argv[++i];
+            if (strcmp(level, "scalar") == 0)    select_simd_level(SIMD_SCALAR);
+            else if (strcmp(level, "sse2") == 0) select_simd_level(SIMD_SSE2);
+            else                                 select_simd_level(SIMD_AVX);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--headless] [--steps N] [--meteors N] [--simd scalar|sse2|avx] [--threads N] [--deterministic] [--seed N] [--record PATH] [--replay PATH]... [--profile] [--trace PATH] [--bg-scale F|auto] [--render-bench] [--wave-interval N] [--wave-size N] [--meteor-cap N] [--meteor-lifetime N] [--destroy-on-hit] [--instances N [--device-dir DIR | --port-stride N] [--show N]]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (spawn.waveInterval > 0 && spawn.waveSize == 0)
+        spawn.waveSize = DEFAULT_WAVE_SIZE;
+    if (spawn.waveInterval > 0 && spawn.maxMeteors == 0)
+        spawn.maxMeteors = std::max(DEFAULT_METEOR_CAP, meteorCount);
+
+    // Physics runs on the job pool, the calling thread helps out
+    init_job_system(&jobs, threadCount);
+    sim.jobs = &jobs;
+    sim.deterministic = deterministic;
+
+    // Replays never need the emulator
+    if (!replayPaths.empty()) {
+        int failures = run_replays(replayPaths);
+        free_job_system(&jobs);
+        return failures == 0 ? 0 : 1;
+    }
 
-Meteor meteors[MAX_METEORS] = {};
+    // Times phases of the main thread, F3 toggles the overlay
+    init_profiler(tracePath);
 
-Meteor *currentSelectedMeteorDebug = nullptr;
+    // Recorded sessions have to replay bit for bit
+    if (recordPath != nullptr)
+        sim.deterministic = true;
 
-int main() {
-    const int width = 1020;
-    const int height = 600;
-    // Wait until response from port
-    if (init_virtual_device() == 0) {
+    // The pool opens the instances' devices itself, no I/O thread
+    if (instanceCount > 0) {
+        if (recordPath != nullptr) {
+            std::cerr << "--record needs a single simulation, not --instances" << std::endl;
+            return 1;
+        }
+        if (init_instance_pool(&pool, instanceCount, width, height, meteorCount, seed, instancePorts, deviceDir,
+                               portStride, &jobs) != 0) {
+            free_job_system(&jobs);
+            return 1;
+        }
+        for (SimInstance &instance : pool.instances)
+            set_meteor_spawn(&instance.sim, &spawn);
+        batchMode = true;
+        shownInstance = shownInstance >= 0 && shownInstance < instanceCount ? shownInstance : 0;
+        if (headless) {
+            int status = run_batch_headless(headlessSteps);
+            free_profiler();
+            free_instance_pool(&pool);
+            free_job_system(&jobs);
+            return status;
+        }
+        pool.maxSteps = headlessSteps;
+    }
+
+    // The I/O thread owns the device from here on and waits for READY
+    if (batchMode) {
+        portAccessAvailable = false;
+    } else if (start_io_thread(&io) == 0) {
         portAccessAvailable = true;
+        std::cout << "Virtual device: " << virtual_device_path()
+                  << (ioDevice.transport == IO_TRANSPORT_MMAP ? " (mmap)" : " (stdio)") << std::endl;
         std::cout << "Waiting for STATUS::READY from port!" << std::endl;
-        unsigned char statusByte;
-        while ((statusByte = read_port_byte(STATUS_PORT)) != Status::READY)
-            ; 
-        std::cout << "Port Value: " << (int) statusByte << std::endl;
         std::cout << "Currnet Path: " << GetWorkingDirectory() << std::endl;
     } else {
         portAccessAvailable = false;
     }
 
+    if (headless) {
+        init_simulation(&sim, width, height, meteorCount, seed);
+        set_meteor_spawn(&sim, &spawn);
+        if (recordPath != nullptr)
+            open_command_recording(&recorder, recordPath, seed, width, height, sim.meteors.count, &sim.spawn);
+        // Without a window there is nothing to show until the emulator is up
+        int status = 0;
+        if (portAccessAvailable && !wait_for_io_connection(&io, HEADLESS_CONNECT_TIMEOUT_MS)) {
+            std::cerr << "No READY from the emulator after " << HEADLESS_CONNECT_TIMEOUT_MS / 1000 << "s, giving up" << std::endl;
+            status = 1;
+        } else {
+            run_headless(headlessSteps);
+        }
+        close_command_recording(&recorder, simulationStep, simulation_hash(&sim));
+        free_profiler();
+        free_simulation(&sim);
+        free_job_system(&jobs);
+        free_port_access();
+        return status;
+    }
+
     InitWindow(width, height, "Rocket Simulation - 8086");
-    SetTargetFPS(60);
+    // The render benchmark measures raw frame time, so no frame cap
+    SetTargetFPS(renderBench ? 0 : TARGET_FPS);
 
+    // Sprites, fonts and the noise texture, from the baked pack when possible
+    const auto assetsStart = std::chrono::steady_clock::now();
+    GameAssets assets;
+    load_game_assets(&assets, "resources", width, height);
+    const double assetsMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - assetsStart).count();
+    const Texture2D &sprite = assets.rocketSprite;
+    const Font &ttfFont = assets.font;
 
-    // Load rocket texture
-    Texture2D sprite = LoadTexture("resources/Main Ship - Base - Full health.png");
     float frameWidth = sprite.width;
     float frameHeight = sprite.height;
-    float frameScaleFactor = 1.5;
-    Rocket rocket = Rocket{0.0};
-    rocket.position = Vector2{width/2, height/2};
-
-    // Load font
-    Font ttfFont = LoadFont("resources/font.ttf");
-
-    Image noiseImage = GenImagePerlinNoise(width, height, 50, 50, 2.5f);
-    Texture2D noiseTexture = LoadTextureFromImage(noiseImage);
-
-    // Intialize shader (distortion cloud)
-    Shader shader = LoadShader(0, TextFormat("resources/space_noise.fs", 330));
-    int useconds = GetShaderLocation(shader, "seconds");
-    int ufreqX =   GetShaderLocation(shader, "freqX");
-    int ufreqY =   GetShaderLocation(shader, "freqY");
-    int uampX =    GetShaderLocation(shader, "ampX");
-    int uampY =    GetShaderLocation(shader, "ampY");
-    int uspeedX =  GetShaderLocation(shader, "speedX");
-    int uspeedY =  GetShaderLocation(shader, "speedY");
-
-    // Shader uniform values that can be updated at any time
-    const float freqX = 10.0f;
-    const float freqY = 10.0f;
-    const float ampX = 2.0f;
-    const float ampY = 2.0f;
-    const float speedX = 3.0f;
-    const float speedY = 3.0f;
-
-    float screenSize[2] = { (float)GetScreenWidth(), (float)GetScreenHeight() };
-    SetShaderValue(shader, GetShaderLocation(shader, "size"), &screenSize, SHADER_UNIFORM_VEC2);
-    SetShaderValue(shader, ufreqX, &freqX, SHADER_UNIFORM_FLOAT);
-    SetShaderValue(shader, ufreqY, &freqY, SHADER_UNIFORM_FLOAT);
-    SetShaderValue(shader, uampX, &ampX, SHADER_UNIFORM_FLOAT);
-    SetShaderValue(shader, uampY, &ampY, SHADER_UNIFORM_FLOAT);
-    SetShaderValue(shader, uspeedX, &speedX, SHADER_UNIFORM_FLOAT);
-    SetShaderValue(shader, uspeedY, &speedY, SHADER_UNIFORM_FLOAT);
-
-
-    // Intialize shader (stars)
-    Image colorImage = GenImageColor(width, height, BLACK);
-    Texture2D colorTexture = LoadTextureFromImage(colorImage);
-    Shader starsShader = LoadShader(0, TextFormat("resources/stars.fs", 330));
-    int utime = GetShaderLocation(starsShader, "time");
-    int ubgcolor = GetShaderLocation(starsShader, "bg_color");
-    Vector4 bg_color = {0.0, 0.0, 0.0, 1.0};
-    SetShaderValue(starsShader, ubgcolor, &bg_color, SHADER_UNIFORM_VEC4);
+    float frameScaleFactor = ROCKET_SCALE_FACTOR;
+    if (!batchMode) {
+        init_simulation(&sim, width, height, meteorCount, seed);
+        set_meteor_spawn(&sim, &spawn);
+    }
+    if (recordPath != nullptr)
+        open_command_recording(&recorder, recordPath, seed, width, height, sim.meteors.count, &sim.spawn);
+    // The simulation on screen, one of the pool's with --instances
+    Simulation *view = batchMode ? &pool.instances[shownInstance].sim : &sim;
+
+    // Noise cloud at reduced resolution plus the cached star field
+    Background background;
+    init_background(&background, assets.noise, width, height, backgroundScale, adaptiveBackground && !renderBench);
 
     float seconds = 0.0f;
 
     // Source rectangle (part of the texture to use for drawing)
     Rectangle sourceRec = { 0.0f, 0.0f, (float)frameWidth, (float)frameHeight };
     // Destination rectangle (screen rectangle where drawing part of texture)
-    Rectangle destRec = { rocket.position.x, rocket.position.y, frameWidth * frameScaleFactor, frameHeight * frameScaleFactor };
+    Rectangle destRec = { view->rocket.position.x, view->rocket.position.y, frameWidth * frameScaleFactor, frameHeight * frameScaleFactor };
     // Origin of the texture (rotation/scale point), it's relative to destination rectangle size
     Vector2 origin = { (float)(frameWidth * frameScaleFactor) / 2, (float)(frameHeight * frameScaleFactor) / 2 };
 
-    // Initialize meteors
-    Texture2D meteorSprite = LoadTexture("resources/Asteroid 01 - Base.png");
-
-    for (int i = 0; i < MAX_METEORS; i++) {
-        Vector2 spawnPosition = Vector2{
-            (float)GetRandomValue(0, width),
-            (float)GetRandomValue(-1, 1) * height
-        };
-        Vector2 velocity = Vector2Subtract(rocket.position, spawnPosition);
-        velocity.x += GetRandomValue(-5, 5);
-        velocity.y += GetRandomValue(-5, 5);
-        velocity = Vector2Normalize(velocity);
-
-        meteors[i] = Meteor{
-            spawnPosition,
-            velocity, 
-            (float)GetRandomValue(0.5, 2.0)
-        };
-    }
+    MeteorRenderer meteorRenderer;
+    init_meteor_renderer(&meteorRenderer, assets.meteorSprite);
+    bool instancedMeteors = !renderBench;
+
+    // --render-bench: RENDER_BENCH_FRAMES frames per path with physics
+    // paused, so only drawing differs. Run with LIBGL_ALWAYS_SOFTWARE=1
+    // to measure Mesa's software rasterizer on a machine without a GPU.
+    int benchFrame = 0;
+    double benchFrameTime[2] = { 0.0, 0.0 };
+    double frameStart = GetTime();
 
     int command = 0;
     // Disregard NOP commands, Used only for displaying the command.
     int lastCommandExecuted = 0;
+    bool firstFrame = true;
+
+    // Debug text is drawn into these and redrawn only when it changes
+    TextLayer hudLayer;
+    init_text_layer(&hudLayer, HUD_LAYER_WIDTH, height);
+    TextLayer meteorPanelLayer;
+    init_text_layer(&meteorPanelLayer, METEOR_PANEL_WIDTH, METEOR_PANEL_HEIGHT);
+    TextLayer meteorLabelLayer;
+    init_text_layer(&meteorLabelLayer, METEOR_LABEL_WIDTH, FONT_SIZE_LARGE);
     while (!WindowShouldClose() && command != Command::EXIT)
     {
+        // Close the previous frame's timings before timing this one
+        profile_end_frame();
+        PROFILE_SCOPE(PHASE_FRAME);
+
+        if (batchMode) {
+            if (running_instances(&pool) == 0)
+                break;
+            // Page keys switch the instance on screen
+            int count = (int)pool.instances.size();
+            int shown = shownInstance;
+            if (IsKeyPressed(KEY_PAGE_DOWN)) shownInstance = (shownInstance + 1) % count;
+            if (IsKeyPressed(KEY_PAGE_UP))   shownInstance = (shownInstance + count - 1) % count;
+            if (shownInstance != shown)
+                selectedMeteor = NULL_METEOR_HANDLE;
+            view = &pool.instances[shownInstance].sim;
+        }
+        Rocket &rocket = view->rocket;
+
         // Process commands from port
         if (portAccessAvailable) {
-            write_port_byte(STATUS_PORT, Status::COMMAND_READY);
-            command = read_port_byte(COMMAND_PORT);
+            PROFILE_SCOPE(PHASE_PORT_INPUT);
+            command = process_port_commands(&rocket);
             lastCommandExecuted = command > 0 ? command : lastCommandExecuted;
-            switch (command) {
-            case Command::ACCEL_POS:
-                rocket.acceleration += ROCKET_ACCELRATION;
-                break;
-            case Command::ACCEL_NEG:
-                rocket.acceleration -= ROCKET_ACCELRATION;
-                break;
-            case Command::ROTATE_RIGHT:
-                rocket.rotation += ROCKET_ROTATION_SPEED;
-                break;
-            case Command::ROTATE_LEFT:
-                rocket.rotation -= ROCKET_ROTATION_SPEED;
-                break;
-            default:
-                break;
-            }
-            // Reset the command port so the command does not get repeated over many cycles
-            write_port_byte(COMMAND_PORT, Command::NOP);
-            write_port_byte(STATUS_PORT, Status::COMMAND_NOT_READY);
         }
 
 
@@ -203,131 +508,95 @@ int main() {
             Vector2 mousePos = GetMousePosition();
             int idx = -1;
             float lowestDistance = 999999;
-            for (int i = 0 ; i < MAX_METEORS; i++) {
-                float distance = Vector2Distance(meteors[i].position, mousePos);
+            for (int i = 0 ; i < view->meteors.count; i++) {
+                float distance = Vector2Distance(meteor_position(&view->meteors, i), mousePos);
                 if (distance < 20 && distance < lowestDistance) {
                     lowestDistance = distance;
                     idx = i;
                 }
             }
-            if (idx != -1)
-                currentSelectedMeteorDebug = &meteors[idx];
-            else
-                currentSelectedMeteorDebug = nullptr;
+            selectedMeteor = idx != -1 ? meteor_handle(&view->pool, idx) : NULL_METEOR_HANDLE;
         }
 
 
         // Manual key control
-        if (IsKeyDown(KEY_LEFT))  rocket.rotation -= ROCKET_ROTATION_SPEED;
-        if (IsKeyDown(KEY_RIGHT)) rocket.rotation += ROCKET_ROTATION_SPEED;
-        if (IsKeyDown(KEY_UP))   rocket.acceleration += ROCKET_ACCELRATION;
-        if (IsKeyDown(KEY_DOWN)) rocket.acceleration -= ROCKET_ACCELRATION;
-
-        // Calculate velocity of rocket relative to the rotation
-        rocket.velocity.x = sin(rocket.rotation * DEG2RAD) * ROCKET_SPEED;
-        rocket.velocity.y = cos(rocket.rotation * DEG2RAD) * ROCKET_SPEED;
-
-        // Update position with velocity and acceleration
-        rocket.position.x += (rocket.velocity.x * rocket.acceleration);
-        rocket.position.y -= (rocket.velocity.y * rocket.acceleration);
+        if (IsKeyDown(KEY_LEFT))  apply_input(&rocket, Command::ROTATE_LEFT);
+        if (IsKeyDown(KEY_RIGHT)) apply_input(&rocket, Command::ROTATE_RIGHT);
+        if (IsKeyDown(KEY_UP))    apply_input(&rocket, Command::ACCEL_POS);
+        if (IsKeyDown(KEY_DOWN))  apply_input(&rocket, Command::ACCEL_NEG);
+        if (IsKeyPressed(KEY_F3)) showProfiler = !showProfiler;
+
+        if (batchMode) {
+            step_instance_pool(&pool);
+        } else if (!renderBench) {
+            step_simulation(&sim);
+            simulationStep++;
+            if (portAccessAvailable)
+                publish_io_telemetry(&io, &sim);
+        }
+        // Despawning moves meteors, find the selected one again
+        currentSelectedMeteorDebug = meteor_index(&view->pool, selectedMeteor);
         destRec.x = rocket.position.x;
         destRec.y = rocket.position.y;
 
         seconds = GetTime();
-        SetShaderValue(shader, useconds, &seconds, SHADER_UNIFORM_FLOAT);
-        SetShaderValue(starsShader, utime, &seconds, SHADER_UNIFORM_FLOAT);
-
-        // Keep the rocket within screen bounds
-        int rocketHeight = destRec.height;
-        if (destRec.x > width + rocketHeight) 
-            rocket.position.x = -rocketHeight;
-        else if (destRec.x < -rocketHeight)
-            rocket.position.x = width + rocketHeight;
-        if (destRec.y > height + rocketHeight)
-            rocket.position.y = -rocketHeight;
-        else if (destRec.y < -rocketHeight)
-            rocket.position.y = height + rocketHeight;
-        
-        Rectangle shipRec;
-        // Check meteor collisions
-        for (int i = 0; i < MAX_METEORS; i++) {
-            // With rocket
-            Meteor *meteor = &meteors[i];
-            bool isColliding = CheckCollisionCircles(meteor->position, meteor->radius * 13.0, rocket.position, destRec.width / 2 - 10.0f);
-            if (isColliding) {
-                Vector2 norm = Vector2Normalize(rocket.velocity);
-                if (abs(rocket.acceleration) < 0.20) {
-                    meteor->velocity.x =  -0.5 * meteor->velocity.x;
-                    meteor->velocity.y =  -0.5 * meteor->velocity.y;
-                } else {
-                    meteor->velocity.x +=  norm.x * rocket.acceleration * METEOR_ROCKET_COLLISION_DAMPING;
-                    meteor->velocity.y +=  -1 * norm.y * rocket.acceleration * METEOR_ROCKET_COLLISION_DAMPING;
-                }
-            }
-
-            // With other meteors
-            for (int j = 0; j < MAX_METEORS; j++) {
-                Meteor *meteor1 = &meteors[j];
-                // No need to check collision for itself
-                if (i == j)
-                    continue;
-                bool isColliding = CheckCollisionCircles(meteor->position, meteor->radius * 13.0, meteor1->position, meteor1->radius * 13.0);
-                if (isColliding) {
-                    // Change direction of meteor after collision relative to size
-                    Vector2 tempMeteor1Vel = meteor1->velocity;
-                    meteor1->velocity.x += meteor->velocity.x * meteor->radius * METEOR_COLLISION_DAMPING ;
-                    meteor1->velocity.y += meteor->velocity.y * meteor->radius * METEOR_COLLISION_DAMPING ;
-                    meteor->velocity.x +=  tempMeteor1Vel.x * meteor1->radius * METEOR_COLLISION_DAMPING;
-                    meteor->velocity.y +=  tempMeteor1Vel.y * meteor1->radius * METEOR_COLLISION_DAMPING;
-                }
-            }
-
-
+        {
+            PROFILE_SCOPE(PHASE_BACKGROUND);
+            adapt_background_scale(&background, GetFrameTime(), 1.0f / TARGET_FPS);
+            render_background(&background, seconds);
         }
 
-        // Update meteors
-        for (int i = 0; i < MAX_METEORS; i++) {
-            Meteor *meteor = &meteors[i];
-            meteor->position.x += meteor->velocity.x;
-            meteor->position.y += meteor->velocity.y;
-            // Dampen asteroids over time
-            if (abs(meteor->velocity.x) > 0.0f) 
-                meteor->velocity.x = Lerp(meteor->velocity.x, 0.0, METEOR_DEACCEL);
-            if (abs(meteor->velocity.y) > 0.0f)
-                meteor->velocity.y = Lerp(meteor->velocity.y, 0.0, METEOR_DEACCEL);
-
-            int meteorHeight = meteorSprite.height;
-            // Meteor wall behaviour
-            if (meteor->position.x > width + meteorHeight)
-                meteor->position.x = -meteorHeight;
-            else if (meteor->position.x < -meteorHeight)
-                meteor->position.x = width + meteorHeight;
-            if (meteor->position.y > height + meteorHeight)
-                meteor->position.y = -meteorHeight;
-            else if (meteor->position.y < -meteorHeight)
-                meteor->position.y = height + meteorHeight;
-
+        // Format the debug text, the layers only redraw when it changed
+        {
+            PROFILE_SCOPE(PHASE_HUD);
+            begin_text_layer(&hudLayer);
+            text_layer_line(&hudLayer, &ttfFont, Vector2{20, 20}, DEFAULT_FONT_SIZE, WHITE, "Position: %03.0f, %03.0f", rocket.position.x, rocket.position.y);
+            text_layer_line(&hudLayer, &ttfFont, Vector2{20, 45}, DEFAULT_FONT_SIZE, WHITE, "Velocity: %0.2f, %0.2f", rocket.velocity.x, rocket.velocity.y);
+            text_layer_line(&hudLayer, &ttfFont, Vector2{20, 70}, DEFAULT_FONT_SIZE, WHITE, "Acceleration: %0.2f", rocket.acceleration);
+            text_layer_line(&hudLayer, &ttfFont, Vector2{20, 95}, DEFAULT_FONT_SIZE, WHITE, "Rotation: %03.f", rocket.rotation);
+            if (batchMode) {
+                const SimInstance &instance = pool.instances[shownInstance];
+                text_layer_line(&hudLayer, &ttfFont, Vector2{20, 120}, DEFAULT_FONT_SIZE, WHITE, "Instance %d/%d: %s", shownInstance + 1, (int)pool.instances.size(), instance_state(&instance));
+                text_layer_line(&hudLayer, &ttfFont, Vector2{20, 145}, DEFAULT_FONT_SIZE, WHITE, "Last run command: %s", command_str_map[instance.lastCommand]);
+                text_layer_line(&hudLayer, &ttfFont, Vector2{20, 170}, DEFAULT_FONT_SIZE, WHITE, "Running: %d, PgUp/PgDn to switch", running_instances(&pool));
+            } else {
+                text_layer_line(&hudLayer, &ttfFont, Vector2{20, 120}, DEFAULT_FONT_SIZE, WHITE, "Connected to port: %s", !portAccessAvailable ? "No" : io.connected ? "Yes" : "Waiting for READY");
+            }
+            if (portAccessAvailable) {
+                text_layer_line(&hudLayer, &ttfFont, Vector2{20, 145}, DEFAULT_FONT_SIZE, WHITE, "Last run command: %s", command_str_map[lastCommandExecuted]);
+                text_layer_line(&hudLayer, &ttfFont, Vector2{20, 170}, DEFAULT_FONT_SIZE, WHITE, "Input latency: %0.2f ms", inputStats.lastLatencyMs);
+            }
+            if (showProfiler)
+                profiler_overlay_lines(&hudLayer, &ttfFont, Vector2{20, 205});
+            end_text_layer(&hudLayer);
+
+            begin_text_layer(&meteorPanelLayer);
+            begin_text_layer(&meteorLabelLayer);
+            if (currentSelectedMeteorDebug != -1) {
+                Vector2 selectedPosition = meteor_position(&view->meteors, currentSelectedMeteorDebug);
+                Vector2 selectedVelocity = meteor_velocity(&view->meteors, currentSelectedMeteorDebug);
+                text_layer_line(&meteorLabelLayer, &assets.fontLarge, Vector2{0, 0}, FONT_SIZE_LARGE, RED, "%u", selectedMeteor.slot);
+                text_layer_line(&meteorPanelLayer, &ttfFont, Vector2{250, 20}, DEFAULT_FONT_SIZE, WHITE, "Position: %03.0f, %03.0f", selectedPosition.x, selectedPosition.y);
+                text_layer_line(&meteorPanelLayer, &ttfFont, Vector2{250, 45}, DEFAULT_FONT_SIZE, WHITE, "Velocity: %0.2f, %0.2f", selectedVelocity.x, selectedVelocity.y);
+            } else {
+                text_layer_line(&meteorPanelLayer, &ttfFont, Vector2{0, 20}, DEFAULT_FONT_SIZE, WHITE, "[Debug]: Click asteroid to see debug info");
+            }
+            end_text_layer(&meteorPanelLayer);
+            end_text_layer(&meteorLabelLayer);
         }
 
 
         BeginDrawing();
             ClearBackground(BLACK);
-            BeginShaderMode(starsShader);
-                DrawTexture(colorTexture, 0, 0, Color{0, 0, 0, 30});
-            EndShaderMode();
-            BeginShaderMode(shader);
-                DrawTexture(noiseTexture, 0, 0, Color{255, 255, 255, 30});
-                DrawTexture(noiseTexture, noiseTexture.width, 0, Color{255, 255, 255, 30});
-            EndShaderMode();
+            {
+                PROFILE_SCOPE(PHASE_BACKGROUND);
+                draw_background(&background, seconds);
+            }
 
             // Draw meteors
-            for (int i = 0; i < MAX_METEORS; i++) {
-                Meteor *meteor = &meteors[i];
-                Rectangle meteorSpriteSourceRec = {0.0f, 0.0f, (float)meteorSprite.width, (float)meteorSprite.height};
-                Rectangle meteorSpriteDestRec   = {meteor->position.x, meteor->position.y, (float)meteorSprite.width * meteor->radius, (float)meteorSprite.height * meteor->radius};
-                Vector2 meteorTextureOrigin     = { (float)(meteorSprite.width * meteor->radius) / 2, (float)(meteorSprite.height * meteor->radius) / 2 };
-                DrawTexturePro(meteorSprite, meteorSpriteSourceRec, meteorSpriteDestRec, meteorTextureOrigin, 0.0, WHITE);
-                // DrawCircle(meteor->position.x, meteor->position.y, meteor->radius * 13.0, ORANGE);
+            {
+                PROFILE_SCOPE(PHASE_METEOR_DRAW);
+                draw_meteors(&meteorRenderer, &view->meteors, instancedMeteors);
             }
 
             // Draw rocket texture
@@ -335,36 +604,64 @@ int main() {
             // DrawCircle(rocket.position.x, rocket.position.y, destRec.width /2 - 10.0f, RED);
 
             // Rocket Debug Information
-            DrawTextEx(ttfFont, TextFormat("Position: %03.0f, %03.0f", rocket.position.x, rocket.position.y), Vector2{20, 20},DEFAULT_FONT_SIZE, 1.0, WHITE );
-            DrawTextEx(ttfFont, TextFormat("Velocity: %0.2f, %0.2f", rocket.velocity.x, rocket.velocity.y), Vector2{20, 45},DEFAULT_FONT_SIZE, 1.0, WHITE );
-            DrawTextEx(ttfFont, TextFormat("Acceleration: %0.2f", rocket.acceleration), Vector2{20, 70},DEFAULT_FONT_SIZE, 1.0, WHITE );
-            DrawTextEx(ttfFont, TextFormat("Rotation: %03.f", rocket.rotation), Vector2{20, 95},DEFAULT_FONT_SIZE, 1.0, WHITE );
-            DrawTextEx(ttfFont, TextFormat("Connected to port: %s", portAccessAvailable ? "Yes" : "No"), Vector2{20, 120},DEFAULT_FONT_SIZE, 1.0, WHITE );
-            if (portAccessAvailable)
-                DrawTextEx(ttfFont, TextFormat("Last run command: %s", command_str_map[lastCommandExecuted]), Vector2{20, 145},DEFAULT_FONT_SIZE, 1.0, WHITE );
-
-            if (currentSelectedMeteorDebug != nullptr) {
-                DrawCircleLines(currentSelectedMeteorDebug->position.x, currentSelectedMeteorDebug->position.y, currentSelectedMeteorDebug->radius * 20.0, RED);
-                DrawTextEx(ttfFont, TextFormat("%d", currentSelectedMeteorDebug - meteors), currentSelectedMeteorDebug->position, 1.5 * DEFAULT_FONT_SIZE, 1.0, RED);
-                DrawTextEx(ttfFont, TextFormat("Position: %03.0f, %03.0f", currentSelectedMeteorDebug->position.x, currentSelectedMeteorDebug->position.y), Vector2{width - 250.0f, 20},DEFAULT_FONT_SIZE, 1.0, WHITE );
-                DrawTextEx(ttfFont, TextFormat("Velocity: %0.2f, %0.2f", currentSelectedMeteorDebug->velocity.x, currentSelectedMeteorDebug->velocity.y), Vector2{width - 250.0, 45},DEFAULT_FONT_SIZE, 1.0, WHITE );
-            } else {
-                DrawTextEx(ttfFont, "[Debug]: Click asteroid to see debug info", Vector2{width - 500.f, 20}, DEFAULT_FONT_SIZE, 1.0, WHITE);
+            {
+                PROFILE_SCOPE(PHASE_HUD);
+                draw_text_layer(&hudLayer, Vector2{0, 0});
+                draw_text_layer(&meteorPanelLayer, Vector2{width - METEOR_PANEL_WIDTH, 0});
+                if (currentSelectedMeteorDebug != -1) {
+                    Vector2 selectedPosition = meteor_position(&view->meteors, currentSelectedMeteorDebug);
+                    DrawCircleLines(selectedPosition.x, selectedPosition.y, view->meteors.radius[currentSelectedMeteorDebug] * 20.0, RED);
+                    draw_text_layer(&meteorLabelLayer, selectedPosition);
+                }
             }
 
-        EndDrawing();
+        {
+            PROFILE_SCOPE(PHASE_PRESENT);
+            EndDrawing();
+        }
+        if (firstFrame) {
+            firstFrame = false;
+            const char *sources[] = { "pack", "baked pack", "sources" };
+            std::cout << "Time to first frame: "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStart).count()
+                      << " ms (assets " << assetsMs << " ms from " << sources[assets.source] << ")" << std::endl;
+        }
+
+        if (renderBench) {
+            double frameEnd = GetTime();
+            benchFrameTime[instancedMeteors ? 1 : 0] += frameEnd - frameStart;
+            frameStart = frameEnd;
+            benchFrame++;
+            // Per-meteor draws first, then the instanced path
+            instancedMeteors = benchFrame >= RENDER_BENCH_FRAMES;
+            if (benchFrame == 2 * RENDER_BENCH_FRAMES)
+                break;
+        }
     }
-    
+
+    if (renderBench) {
+        std::cout << "Render bench, " << view->meteors.count << " meteors, "
+                  << (meteorRenderer.instanced ? "instancing available" : "no instancing (GL < 3.3)") << std::endl;
+        std::cout << "DrawTexturePro per meteor: " << benchFrameTime[0] * 1000.0 / RENDER_BENCH_FRAMES << " ms/frame" << std::endl;
+        std::cout << "Instanced single draw:     " << benchFrameTime[1] * 1000.0 / RENDER_BENCH_FRAMES << " ms/frame" << std::endl;
+    }
+
     // De-initialization
-    UnloadShader(shader); 
-    UnloadTexture(sprite);
+    unload_background(&background);
+    unload_meteor_renderer(&meteorRenderer);
+    unload_game_assets(&assets);
+    unload_text_layer(&hudLayer);
+    unload_text_layer(&meteorPanelLayer);
+    unload_text_layer(&meteorLabelLayer);
     CloseWindow();
     
-
-    // Port De-initialization
-    write_port_byte(STATUS_PORT, Status::NOT_READY);
-    write_port_byte(COMMAND_PORT, Command::NOP);
-    free_virtual_device();
+    close_command_recording(&recorder, simulationStep, simulation_hash(&sim));
+    free_profiler();
+    free_simulation(&sim);
+    if (batchMode)
+        free_instance_pool(&pool);
+    free_job_system(&jobs);
+    free_port_access();
 
     return 0;
-}
\ No newline at end of file
+}
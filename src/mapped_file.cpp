@@ -0,0 +1,67 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+int map_file(MappedFile *file, const char *path) {
+    *file = MappedFile{};
+#if defined(_WIN32)
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return -1;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    // The view keeps the file open
+    CloseHandle(handle);
+    if (mapping == NULL)
+        return -1;
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        return -1;
+    }
+    file->data = (const unsigned char *)view;
+    file->size = (size_t)size.QuadPart;
+    file->handle = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return -1;
+    file->data = (const unsigned char *)view;
+    file->size = (size_t)st.st_size;
+#endif
+    return 0;
+}
+
+void unmap_file(MappedFile *file) {
+    if (file->data == NULL)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile((LPCVOID)file->data);
+    CloseHandle((HANDLE)file->handle);
+#else
+    munmap((void *)file->data, file->size);
+#endif
+    *file = MappedFile{};
+}
@@ -0,0 +1,17 @@
+/*
+	Read-only memory mapping of a whole file. Kept apart from anything
+	that includes raylib.h so <windows.h> can be used on Windows.
+*/
+#pragma once
+
+#include <cstddef>
+
+typedef struct MappedFile {
+    const unsigned char *data;
+    size_t size;
+    void *handle; // Windows mapping handle, unused elsewhere
+} MappedFile;
+
+// Returns 0 on success. An empty file can't be mapped and fails.
+int map_file(MappedFile *file, const char *path);
+void unmap_file(MappedFile *file);
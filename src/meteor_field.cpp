@@ -0,0 +1,228 @@
+#include <cstring>
+#include <new>
+#include "meteor_field.h"
+#include "simulation.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define METEOR_SIMD_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define TARGET_AVX
+    #else
+        #define TARGET_AVX __attribute__((target("avx")))
+    #endif
+#endif
+
+#define METEOR_ATTRIBUTES 5
+
+typedef void (*IntegrateKernel)(const MeteorField *current, MeteorField *next, int begin, int end,
+                                float minX, float maxX, float minY, float maxY);
+
+static int round_up(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+void resize_meteor_field(MeteorField *field, int count) {
+    if (count <= field->capacity) {
+        // Clear slots past the new count so the padding stays inert
+        for (float *array : { field->positionX, field->positionY, field->velocityX, field->velocityY, field->radius }) {
+            if (array != nullptr && count < field->capacity)
+                memset(array + count, 0, (field->capacity - count) * sizeof(float));
+        }
+        field->count = count;
+        return;
+    }
+
+    const int capacity = round_up(count, METEOR_LANES);
+    float *block = static_cast<float *>(::operator new[](
+        (size_t)capacity * METEOR_ATTRIBUTES * sizeof(float), std::align_val_t(METEOR_ALIGNMENT)));
+    memset(block, 0, (size_t)capacity * METEOR_ATTRIBUTES * sizeof(float));
+
+    // One block, each attribute starts on a METEOR_ALIGNMENT boundary
+    float *arrays[METEOR_ATTRIBUTES];
+    for (int i = 0; i < METEOR_ATTRIBUTES; i++)
+        arrays[i] = block + (size_t)i * capacity;
+    if (field->count > 0) {
+        const float *old[METEOR_ATTRIBUTES] = { field->positionX, field->positionY, field->velocityX, field->velocityY, field->radius };
+        for (int i = 0; i < METEOR_ATTRIBUTES; i++)
+            memcpy(arrays[i], old[i], field->count * sizeof(float));
+    }
+    free_meteor_field(field);
+
+    field->positionX = arrays[0];
+    field->positionY = arrays[1];
+    field->velocityX = arrays[2];
+    field->velocityY = arrays[3];
+    field->radius = arrays[4];
+    field->capacity = capacity;
+    field->count = count;
+}
+
+void free_meteor_field(MeteorField *field) {
+    if (field->positionX != nullptr)
+        ::operator delete[](field->positionX, std::align_val_t(METEOR_ALIGNMENT));
+    *field = MeteorField{};
+}
+
+void reserve_meteor_field(MeteorField *field, int capacity) {
+    if (capacity <= field->capacity)
+        return;
+    const int count = field->count;
+    resize_meteor_field(field, capacity);
+    resize_meteor_field(field, count);
+}
+
+void remove_meteor(MeteorField *field, int i) {
+    const int last = field->count - 1;
+    float *arrays[METEOR_ATTRIBUTES] = { field->positionX, field->positionY, field->velocityX, field->velocityY, field->radius };
+    for (float *array : arrays) {
+        array[i] = array[last];
+        // Keep the padding inert
+        array[last] = 0.0f;
+    }
+    field->count = last;
+}
+
+// Lerp(velocity, 0, METEOR_DEACCEL) is written out as v + a * (0 - v) in
+// every kernel so all levels produce bit-identical results
+static void integrate_meteors_scalar(const MeteorField *current, MeteorField *next, int begin, int end,
+                                     float minX, float maxX, float minY, float maxY) {
+    for (int i = begin; i < end; i++) {
+        float x = current->positionX[i] + next->velocityX[i];
+        float y = current->positionY[i] + next->velocityY[i];
+        next->velocityX[i] = next->velocityX[i] + METEOR_DEACCEL * (0.0f - next->velocityX[i]);
+        next->velocityY[i] = next->velocityY[i] + METEOR_DEACCEL * (0.0f - next->velocityY[i]);
+
+        // Meteor wall behaviour
+        if (x > maxX)
+            x = minX;
+        else if (x < minX)
+            x = maxX;
+        if (y > maxY)
+            y = minY;
+        else if (y < minY)
+            y = maxY;
+        next->positionX[i] = x;
+        next->positionY[i] = y;
+    }
+}
+
+#if defined(METEOR_SIMD_X86)
+static inline __m128 wrap_sse2(__m128 value, __m128 min, __m128 max) {
+    __m128 above = _mm_cmpgt_ps(value, max);
+    __m128 below = _mm_cmplt_ps(value, min);
+    value = _mm_or_ps(_mm_andnot_ps(above, value), _mm_and_ps(above, min));
+    return _mm_or_ps(_mm_andnot_ps(below, value), _mm_and_ps(below, max));
+}
+
+static void integrate_meteors_sse2(const MeteorField *current, MeteorField *next, int begin, int end,
+                                   float minX, float maxX, float minY, float maxY) {
+    const __m128 deaccel = _mm_set1_ps(METEOR_DEACCEL);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minXs = _mm_set1_ps(minX), maxXs = _mm_set1_ps(maxX);
+    const __m128 minYs = _mm_set1_ps(minY), maxYs = _mm_set1_ps(maxY);
+    end = round_up(end, 4);
+
+    for (int i = begin; i < end; i += 4) {
+        __m128 vx = _mm_load_ps(next->velocityX + i);
+        __m128 vy = _mm_load_ps(next->velocityY + i);
+        __m128 x = _mm_add_ps(_mm_load_ps(current->positionX + i), vx);
+        __m128 y = _mm_add_ps(_mm_load_ps(current->positionY + i), vy);
+        vx = _mm_add_ps(vx, _mm_mul_ps(deaccel, _mm_sub_ps(zero, vx)));
+        vy = _mm_add_ps(vy, _mm_mul_ps(deaccel, _mm_sub_ps(zero, vy)));
+        _mm_store_ps(next->velocityX + i, vx);
+        _mm_store_ps(next->velocityY + i, vy);
+        _mm_store_ps(next->positionX + i, wrap_sse2(x, minXs, maxXs));
+        _mm_store_ps(next->positionY + i, wrap_sse2(y, minYs, maxYs));
+    }
+}
+
+TARGET_AVX static inline __m256 wrap_avx(__m256 value, __m256 min, __m256 max) {
+    __m256 above = _mm256_cmp_ps(value, max, _CMP_GT_OQ);
+    __m256 below = _mm256_cmp_ps(value, min, _CMP_LT_OQ);
+    value = _mm256_blendv_ps(value, min, above);
+    return _mm256_blendv_ps(value, max, below);
+}
+
+TARGET_AVX static void integrate_meteors_avx(const MeteorField *current, MeteorField *next, int begin, int end,
+                                             float minX, float maxX, float minY, float maxY) {
+    const __m256 deaccel = _mm256_set1_ps(METEOR_DEACCEL);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 minXs = _mm256_set1_ps(minX), maxXs = _mm256_set1_ps(maxX);
+    const __m256 minYs = _mm256_set1_ps(minY), maxYs = _mm256_set1_ps(maxY);
+    end = round_up(end, METEOR_LANES);
+
+    for (int i = begin; i < end; i += METEOR_LANES) {
+        __m256 vx = _mm256_load_ps(next->velocityX + i);
+        __m256 vy = _mm256_load_ps(next->velocityY + i);
+        __m256 x = _mm256_add_ps(_mm256_load_ps(current->positionX + i), vx);
+        __m256 y = _mm256_add_ps(_mm256_load_ps(current->positionY + i), vy);
+        vx = _mm256_add_ps(vx, _mm256_mul_ps(deaccel, _mm256_sub_ps(zero, vx)));
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(deaccel, _mm256_sub_ps(zero, vy)));
+        _mm256_store_ps(next->velocityX + i, vx);
+        _mm256_store_ps(next->velocityY + i, vy);
+        _mm256_store_ps(next->positionX + i, wrap_avx(x, minXs, maxXs));
+        _mm256_store_ps(next->positionY + i, wrap_avx(y, minYs, maxYs));
+    }
+}
+#endif
+
+SimdLevel detect_simd_level() {
+#if defined(METEOR_SIMD_X86)
+    #if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osUsesXsave = (info[2] & (1 << 27)) != 0;
+    bool cpuHasAvx = (info[2] & (1 << 28)) != 0;
+    // The OS must also save the upper halves of the YMM registers
+    if (osUsesXsave && cpuHasAvx && (_xgetbv(0) & 0x6) == 0x6)
+        return SIMD_AVX;
+    if (info[3] & (1 << 26))
+        return SIMD_SSE2;
+    #else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+        return SIMD_AVX;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+    #endif
+#endif
+    return SIMD_SCALAR;
+}
+
+static IntegrateKernel kernel_for_level(SimdLevel level) {
+#if defined(METEOR_SIMD_X86)
+    if (level == SIMD_AVX)
+        return integrate_meteors_avx;
+    if (level == SIMD_SSE2)
+        return integrate_meteors_sse2;
+#endif
+    return integrate_meteors_scalar;
+}
+
+static SimdLevel activeSimdLevel = detect_simd_level();
+static IntegrateKernel integrateKernel = kernel_for_level(activeSimdLevel);
+
+void select_simd_level(SimdLevel level) {
+    SimdLevel supported = detect_simd_level();
+    activeSimdLevel = level > supported ? supported : level;
+    integrateKernel = kernel_for_level(activeSimdLevel);
+}
+
+SimdLevel active_simd_level() {
+    return activeSimdLevel;
+}
+
+const char *simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX:  return "avx";
+    case SIMD_SSE2: return "sse2";
+    default:        return "scalar";
+    }
+}
+
+void integrate_meteors(const MeteorField *current, MeteorField *next, int begin, int end,
+                       float minX, float maxX, float minY, float maxY) {
+    integrateKernel(current, next, begin, end, minX, maxX, minY, maxY);
+}
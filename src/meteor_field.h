@@ -0,0 +1,60 @@
+/*
+	Structure-of-arrays storage for meteors. Every attribute lives in
+	its own array aligned for AVX and padded to a whole number of
+	vectors, so the integration kernel can run full-width over the
+	padding without a scalar tail. The kernel (integrate, damp, wrap)
+	is picked at startup from what the CPU supports.
+*/
+#pragma once
+
+#include <raylib.h>
+
+#define METEOR_ALIGNMENT 32 // Bytes, one AVX register
+#define METEOR_LANES 8      // Floats per AVX register
+
+typedef struct MeteorField {
+    int count;
+    int capacity; // Multiple of METEOR_LANES, padding is zeroed
+    float *positionX;
+    float *positionY;
+    float *velocityX;
+    float *velocityY;
+    float *radius;    // Scale factor of texture (1.0 default)
+} MeteorField;
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX,
+};
+
+// Grow the field to hold at least count meteors and set count.
+// Existing meteors are kept, new slots and padding are zeroed.
+void resize_meteor_field(MeteorField *field, int count);
+void free_meteor_field(MeteorField *field);
+// Grow the storage to hold capacity meteors without changing count
+void reserve_meteor_field(MeteorField *field, int capacity);
+// Move the last meteor into slot i and drop the last slot. Never allocates.
+void remove_meteor(MeteorField *field, int i);
+
+inline Vector2 meteor_position(const MeteorField *field, int i) {
+    return Vector2{ field->positionX[i], field->positionY[i] };
+}
+
+inline Vector2 meteor_velocity(const MeteorField *field, int i) {
+    return Vector2{ field->velocityX[i], field->velocityY[i] };
+}
+
+// Best level the CPU supports
+SimdLevel detect_simd_level();
+// Use a given kernel level, clamped to what the CPU supports
+void select_simd_level(SimdLevel level);
+SimdLevel active_simd_level();
+const char *simd_level_name(SimdLevel level);
+
+// For meteors [begin, end): next.position = current.position + next.velocity,
+// next.velocity = Lerp(next.velocity, 0, METEOR_DEACCEL), then wrap positions
+// leaving [min, max] to the opposite edge. begin must be a multiple of
+// METEOR_LANES. current and next may be the same field.
+void integrate_meteors(const MeteorField *current, MeteorField *next, int begin, int end,
+                       float minX, float maxX, float minY, float maxY);
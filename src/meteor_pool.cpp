@@ -0,0 +1,53 @@
+#include "meteor_pool.h"
+
+void reserve_meteor_pool(MeteorPool *pool, int capacity) {
+    if (capacity <= pool->capacity)
+        return;
+    pool->generation.resize(capacity, 0);
+    pool->slotIndex.resize(capacity, -1);
+    pool->spawnStep.resize(capacity, 0);
+    pool->indexSlot.resize(capacity, NO_METEOR_SLOT);
+    pool->freeSlots.reserve(capacity);
+    // New slots go under the free ones, lowest slot nearest the top
+    pool->freeSlots.insert(pool->freeSlots.begin(), capacity - pool->capacity, 0);
+    for (int slot = capacity - 1, i = 0; slot >= pool->capacity; slot--, i++)
+        pool->freeSlots[i] = (uint32_t)slot;
+    pool->capacity = capacity;
+}
+
+void clear_meteor_pool(MeteorPool *pool) {
+    pool->freeSlots.clear();
+    for (int slot = pool->capacity - 1; slot >= 0; slot--) {
+        if (pool->slotIndex[slot] >= 0)
+            pool->generation[slot]++;
+        pool->slotIndex[slot] = -1;
+        pool->indexSlot[slot] = NO_METEOR_SLOT;
+        pool->freeSlots.push_back((uint32_t)slot);
+    }
+}
+
+bool add_meteor_slot(MeteorPool *pool, int index, uint64_t step) {
+    if (pool->freeSlots.empty())
+        return false;
+    uint32_t slot = pool->freeSlots.back();
+    pool->freeSlots.pop_back();
+    pool->slotIndex[slot] = index;
+    pool->spawnStep[slot] = step;
+    pool->indexSlot[index] = slot;
+    return true;
+}
+
+void remove_meteor_slot(MeteorPool *pool, int index, int last) {
+    uint32_t slot = pool->indexSlot[index];
+    // Old handles to this slot stop resolving
+    pool->generation[slot]++;
+    pool->slotIndex[slot] = -1;
+    pool->freeSlots.push_back(slot);
+
+    if (last != index) {
+        uint32_t moved = pool->indexSlot[last];
+        pool->slotIndex[moved] = index;
+        pool->indexSlot[index] = moved;
+    }
+    pool->indexSlot[last] = NO_METEOR_SLOT;
+}
@@ -0,0 +1,73 @@
+/*
+	Stable handles for meteors that come and go. The meteors themselves
+	stay densely packed in the MeteorField arrays: [0, count) are all
+	alive, so the kernels never test for dead entries. Despawning moves
+	the last meteor into the hole. A handle names a slot instead of an
+	index. The pool maps every slot to its meteor's current index and
+	back, and bumps a slot's generation when its meteor is despawned, so
+	a stale handle resolves to nothing instead of to whatever moved in.
+
+	Freed slots go on a free list and are reused by the next spawn. The
+	arrays are sized by reserve_meteor_pool, adding and removing meteors
+	never allocates.
+*/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define NO_METEOR_SLOT 0xFFFFFFFFu
+
+typedef struct MeteorHandle {
+    uint32_t slot;
+    uint32_t generation;
+} MeteorHandle;
+
+const MeteorHandle NULL_METEOR_HANDLE = { NO_METEOR_SLOT, 0 };
+
+// Meteor churn. Everything is off when zeroed, then the meteors spawned
+// by init_simulation live forever.
+typedef struct MeteorSpawn {
+    int32_t waveInterval; // Steps between waves, 0 for no waves
+    int32_t waveSize;     // Meteors per wave
+    int32_t maxMeteors;   // Waves stop at this many live meteors
+    int32_t lifetime;     // Steps a meteor lives, 0 for ever
+    bool destroyOnHit;    // Despawn meteors that touch the rocket
+} MeteorSpawn;
+
+typedef struct MeteorPool {
+    int capacity;
+    std::vector<uint32_t> generation; // Per slot
+    std::vector<int> slotIndex;       // Per slot, field index or -1 when free
+    std::vector<uint64_t> spawnStep;  // Per slot
+    std::vector<uint32_t> indexSlot;  // Per field index
+    std::vector<uint32_t> freeSlots;  // Stack, the last freed slot is reused first
+} MeteorPool;
+
+// Grow to capacity slots. Live meteors keep their handles.
+void reserve_meteor_pool(MeteorPool *pool, int capacity);
+// Free every slot
+void clear_meteor_pool(MeteorPool *pool);
+
+// Take a slot for the meteor just appended at index. Returns false when
+// every slot is in use.
+bool add_meteor_slot(MeteorPool *pool, int index, uint64_t step);
+// Free the slot of the meteor at index. last is the index of the meteor
+// that was moved into it, or index itself if it was the last one.
+void remove_meteor_slot(MeteorPool *pool, int index, int last);
+
+inline MeteorHandle meteor_handle(const MeteorPool *pool, int index) {
+    uint32_t slot = pool->indexSlot[index];
+    return MeteorHandle{ slot, pool->generation[slot] };
+}
+
+// Current field index of the meteor, -1 once it was despawned
+inline int meteor_index(const MeteorPool *pool, MeteorHandle handle) {
+    if (handle.slot >= (uint32_t)pool->capacity || pool->generation[handle.slot] != handle.generation)
+        return -1;
+    return pool->slotIndex[handle.slot];
+}
+
+inline uint64_t meteor_spawn_step(const MeteorPool *pool, int index) {
+    return pool->spawnStep[pool->indexSlot[index]];
+}
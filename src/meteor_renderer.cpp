@@ -0,0 +1,133 @@
+#include <vector>
+#include <raylib.h>
+#include <raymath.h>
+#include <rlgl.h>
+#include "meteor_renderer.h"
+
+#define INSTANCE_ATTRIBUTES 4
+
+static const char *INSTANCE_ATTRIBUTE_NAMES[INSTANCE_ATTRIBUTES] = {
+    "instancePositionX",
+    "instancePositionY",
+    "instanceScale",
+    "instanceRotation",
+};
+
+// Two triangles of a unit quad centred on the origin: x, y, z, u, v
+static const float QUAD_VERTICES[] = {
+    -0.5f, -0.5f, 0.0f,   0.0f, 0.0f,
+     0.5f, -0.5f, 0.0f,   1.0f, 0.0f,
+     0.5f,  0.5f, 0.0f,   1.0f, 1.0f,
+    -0.5f, -0.5f, 0.0f,   0.0f, 0.0f,
+     0.5f,  0.5f, 0.0f,   1.0f, 1.0f,
+    -0.5f,  0.5f, 0.0f,   0.0f, 1.0f,
+};
+
+// (Re)create the instance buffer with room for capacity meteors. Each
+// attribute reads its own region, so the SoA arrays upload unchanged.
+static void resize_instance_buffer(MeteorRenderer *renderer, int capacity) {
+    if (renderer->instanceVbo != 0)
+        rlUnloadVertexBuffer(renderer->instanceVbo);
+    renderer->capacity = capacity;
+
+    rlEnableVertexArray(renderer->vao);
+    renderer->instanceVbo = rlLoadVertexBuffer(NULL, capacity * INSTANCE_ATTRIBUTES * sizeof(float), true);
+    for (int i = 0; i < INSTANCE_ATTRIBUTES; i++) {
+        int loc = renderer->instanceLocs[i];
+        if (loc < 0)
+            continue;
+        rlSetVertexAttribute(loc, 1, RL_FLOAT, false, 0, (const void *)(i * capacity * sizeof(float)));
+        rlEnableVertexAttribute(loc);
+        rlSetVertexAttributeDivisor(loc, 1);
+    }
+    rlDisableVertexArray();
+
+    // Meteors do not spin yet, rotation stays zero
+    std::vector<float> zeros(capacity, 0.0f);
+    rlUpdateVertexBuffer(renderer->instanceVbo, zeros.data(), capacity * sizeof(float), 3 * capacity * sizeof(float));
+}
+
+void init_meteor_renderer(MeteorRenderer *renderer, Texture2D texture) {
+    *renderer = MeteorRenderer{};
+    renderer->texture = texture;
+    renderer->instanced = rlGetVersion() == RL_OPENGL_33 || rlGetVersion() == RL_OPENGL_43;
+    if (!renderer->instanced)
+        return;
+
+    renderer->shader = LoadShader("resources/meteor_instanced.vs", "resources/meteor_instanced.fs");
+    renderer->mvpLoc = GetShaderLocation(renderer->shader, "mvp");
+    renderer->spriteSizeLoc = GetShaderLocation(renderer->shader, "spriteSize");
+    renderer->colDiffuseLoc = GetShaderLocation(renderer->shader, "colDiffuse");
+    for (int i = 0; i < INSTANCE_ATTRIBUTES; i++)
+        renderer->instanceLocs[i] = rlGetLocationAttrib(renderer->shader.id, INSTANCE_ATTRIBUTE_NAMES[i]);
+
+    renderer->vao = rlLoadVertexArray();
+    rlEnableVertexArray(renderer->vao);
+    renderer->quadVbo = rlLoadVertexBuffer(QUAD_VERTICES, sizeof(QUAD_VERTICES), false);
+    // LoadShader binds vertexPosition to 0 and vertexTexCoord to 1
+    rlSetVertexAttribute(0, 3, RL_FLOAT, false, 5 * sizeof(float), (const void *)0);
+    rlEnableVertexAttribute(0);
+    rlSetVertexAttribute(1, 2, RL_FLOAT, false, 5 * sizeof(float), (const void *)(3 * sizeof(float)));
+    rlEnableVertexAttribute(1);
+    rlDisableVertexArray();
+}
+
+void unload_meteor_renderer(MeteorRenderer *renderer) {
+    if (renderer->instanced) {
+        rlUnloadVertexBuffer(renderer->instanceVbo);
+        rlUnloadVertexBuffer(renderer->quadVbo);
+        rlUnloadVertexArray(renderer->vao);
+        UnloadShader(renderer->shader);
+    }
+    *renderer = MeteorRenderer{};
+}
+
+// Original path: one DrawTexturePro per meteor
+static void draw_meteors_immediate(MeteorRenderer *renderer, const MeteorField *meteors) {
+    const Texture2D meteorSprite = renderer->texture;
+    Rectangle meteorSpriteSourceRec = {0.0f, 0.0f, (float)meteorSprite.width, (float)meteorSprite.height};
+    for (int i = 0; i < meteors->count; i++) {
+        float radius = meteors->radius[i];
+        Rectangle meteorSpriteDestRec   = {meteors->positionX[i], meteors->positionY[i], (float)meteorSprite.width * radius, (float)meteorSprite.height * radius};
+        Vector2 meteorTextureOrigin     = { (float)(meteorSprite.width * radius) / 2, (float)(meteorSprite.height * radius) / 2 };
+        DrawTexturePro(meteorSprite, meteorSpriteSourceRec, meteorSpriteDestRec, meteorTextureOrigin, 0.0, WHITE);
+    }
+}
+
+void draw_meteors(MeteorRenderer *renderer, const MeteorField *meteors, bool useInstancing) {
+    if (!useInstancing || !renderer->instanced) {
+        draw_meteors_immediate(renderer, meteors);
+        return;
+    }
+    if (meteors->count == 0)
+        return;
+    if (meteors->count > renderer->capacity)
+        resize_instance_buffer(renderer, meteors->capacity);
+
+    // Flush what raylib has batched so far to keep the draw order
+    rlDrawRenderBatchActive();
+
+    const int bytes = meteors->count * sizeof(float);
+    const int region = renderer->capacity * sizeof(float);
+    rlUpdateVertexBuffer(renderer->instanceVbo, meteors->positionX, bytes, 0);
+    rlUpdateVertexBuffer(renderer->instanceVbo, meteors->positionY, bytes, region);
+    rlUpdateVertexBuffer(renderer->instanceVbo, meteors->radius, bytes, 2 * region);
+
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    float spriteSize[2] = { (float)renderer->texture.width, (float)renderer->texture.height };
+    float colDiffuse[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    rlEnableShader(renderer->shader.id);
+    rlSetUniformMatrix(renderer->mvpLoc, mvp);
+    rlSetUniform(renderer->spriteSizeLoc, spriteSize, RL_SHADER_UNIFORM_VEC2, 1);
+    rlSetUniform(renderer->colDiffuseLoc, colDiffuse, RL_SHADER_UNIFORM_VEC4, 1);
+    rlActiveTextureSlot(0);
+    rlEnableTexture(renderer->texture.id);
+
+    rlEnableVertexArray(renderer->vao);
+    rlDrawVertexArrayInstanced(0, 6, meteors->count);
+    rlDisableVertexArray();
+
+    rlDisableTexture();
+    rlDisableShader();
+}
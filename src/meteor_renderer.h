@@ -0,0 +1,31 @@
+/*
+	Draws every meteor with one instanced draw call. The MeteorField
+	arrays are uploaded as they are into one vertex buffer (x, y and
+	scale regions) once per frame; the vertex shader builds each quad.
+	Needs OpenGL 3.3, on older contexts draw_meteors falls back to one
+	DrawTexturePro per meteor.
+*/
+#pragma once
+
+#include <raylib.h>
+#include "meteor_field.h"
+
+typedef struct MeteorRenderer {
+    Texture2D texture;
+    Shader shader;
+    bool instanced;           // False when the GL context cannot instance
+    unsigned int vao;
+    unsigned int quadVbo;
+    unsigned int instanceVbo; // [x... | y... | scale... | rotation...]
+    int capacity;             // Meteors the instance buffer can hold
+    int mvpLoc;
+    int spriteSizeLoc;
+    int colDiffuseLoc;
+    int instanceLocs[4];
+} MeteorRenderer;
+
+void init_meteor_renderer(MeteorRenderer *renderer, Texture2D texture);
+void unload_meteor_renderer(MeteorRenderer *renderer);
+
+// One instanced draw, or the per-meteor path if useInstancing is false
+void draw_meteors(MeteorRenderer *renderer, const MeteorField *meteors, bool useInstancing = true);
@@ -0,0 +1,102 @@
+#include <chrono>
+#include <thread>
+#include "port_protocol.h"
+
+// Command::NOP, kept here so this file does not need raylib
+#define NOP_COMMAND 0
+
+static int read_port(PortProtocol *protocol, long port) {
+    return read_device_byte(protocol->device, protocol->portBase + port);
+}
+
+static void write_port(PortProtocol *protocol, long port, unsigned char value) {
+    write_device_byte(protocol->device, protocol->portBase + port, value);
+}
+
+// Mark the telemetry block as holding no frame: an odd sequence first,
+// so a reader drops the block before the words are zeroed
+static void clear_telemetry(PortProtocol *protocol) {
+    const unsigned char noFrame[2] = { TELEMETRY_NO_FRAME & 0xFF, TELEMETRY_NO_FRAME >> 8 };
+    const unsigned char zeros[TELEMETRY_SIZE - 2] = {};
+    const long base = protocol->portBase + TELEMETRY_BASE_PORT;
+    write_device_block(protocol->device, base, noFrame, sizeof(noFrame));
+    write_device_block(protocol->device, base + 2, zeros, sizeof(zeros));
+}
+
+bool port_program_ready(VirtualDevice *device, long portBase) {
+    return read_device_byte(device, portBase + STATUS_PORT) == Status::READY;
+}
+
+void init_port_protocol(PortProtocol *protocol, VirtualDevice *device, long portBase) {
+    protocol->device = device;
+    protocol->portBase = portBase;
+    protocol->version = read_port(protocol, PROTOCOL_PORT) == PROTOCOL_VERSION_RING
+        ? PROTOCOL_VERSION_RING : PROTOCOL_VERSION_LEGACY;
+    // The program cleared both indices before READY, so this is 0 unless
+    // it already queued commands while we were starting up
+    protocol->tail = read_port(protocol, RING_TAIL_PORT);
+    protocol->readyWindowUs = 0;
+    // A frame left by an earlier run must not pass for ours
+    clear_telemetry(protocol);
+    if (protocol->version == PROTOCOL_VERSION_LEGACY)
+        write_port(protocol, STATUS_PORT, Status::COMMAND_NOT_READY);
+}
+
+void free_port_protocol(PortProtocol *protocol) {
+    write_port(protocol, PROTOCOL_PORT, 0);
+    write_port(protocol, STATUS_PORT, Status::NOT_READY);
+    write_port(protocol, COMMAND_PORT, NOP_COMMAND);
+    // The last frame would look valid to the next program otherwise
+    clear_telemetry(protocol);
+    protocol->version = PROTOCOL_VERSION_LEGACY;
+}
+
+// Take the command in COMMAND_PORT, if any, and reset the port so the
+// command does not get repeated over many cycles. Returns 1 if there
+// was one. Read and reset are one exchange, so a command the program
+// writes meanwhile is not wiped by the reset.
+static int take_legacy_command(PortProtocol *protocol, unsigned char *command) {
+    *command = exchange_device_byte(protocol->device, protocol->portBase + COMMAND_PORT, NOP_COMMAND);
+    return *command != NOP_COMMAND ? 1 : 0;
+}
+
+// STATUS_PORT is COMMAND_NOT_READY between calls, so a command written
+// in the last call stays put until we take it here. COMMAND_READY is
+// only shown until one command arrives, so the program cannot write a
+// second command over one we have not taken.
+static int receive_legacy_commands(PortProtocol *protocol, unsigned char *commands, int maxCommands) {
+    int count = take_legacy_command(protocol, commands);
+    if (count == maxCommands)
+        return count;
+
+    write_port(protocol, STATUS_PORT, Status::COMMAND_READY);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(protocol->readyWindowUs);
+    int taken = take_legacy_command(protocol, commands + count);
+    while (taken == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+        taken = take_legacy_command(protocol, commands + count);
+    }
+    write_port(protocol, STATUS_PORT, Status::COMMAND_NOT_READY);
+    return count + taken;
+}
+
+int receive_port_commands(PortProtocol *protocol, unsigned char *commands, int maxCommands) {
+    if (maxCommands <= 0)
+        return 0;
+    if (protocol->version != PROTOCOL_VERSION_RING)
+        return receive_legacy_commands(protocol, commands, maxCommands);
+
+    // read_device_byte orders the slot reads after this load of head
+    unsigned char head = read_port(protocol, RING_HEAD_PORT);
+    unsigned char pending = head - protocol->tail;
+    int count = pending < maxCommands ? pending : maxCommands;
+    for (int i = 0; i < count; i++)
+        commands[i] = read_port(protocol, RING_BASE_PORT + ((protocol->tail + i) & RING_MASK));
+
+    // One write hands all drained slots back to the program
+    if (count > 0) {
+        protocol->tail += count;
+        write_port(protocol, RING_TAIL_PORT, protocol->tail);
+    }
+    return count;
+}
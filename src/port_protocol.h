@@ -0,0 +1,117 @@
+/*
+	Command protocol between the 8086 program and the device, on top
+	of the ports in virtual.h.
+
+	Version 1 (legacy) is one command at a time: the program waits for
+	COMMAND_READY in STATUS_PORT before every key. STATUS_PORT holds
+	COMMAND_NOT_READY except for a moment on every poll, when the device
+	sets COMMAND_READY and watches COMMAND_PORT. It sets
+	COMMAND_NOT_READY again as soon as a command arrives, or after
+	readyWindowUs. A command written then waits in COMMAND_PORT until
+	the device reads it and resets the port to NOP.
+
+	Version 2 is a single-producer/single-consumer ring of RING_SIZE
+	command bytes at RING_BASE_PORT. The program owns RING_HEAD_PORT,
+	the device owns RING_TAIL_PORT. Both are free running 8 bit
+	counters, the slot of index i is RING_BASE_PORT + (i & RING_MASK),
+	and the ring is full when head - tail == RING_SIZE. The program
+	fills slots, then publishes them with a single write of the new
+	head. The device drains every published command each step and
+	writes the new tail back. Commands keep the meaning of Command.
+
+	The program selects version 2 by clearing both indices and writing
+	PROTOCOL_VERSION_RING to PROTOCOL_PORT before it sends READY. The
+	device clears PROTOCOL_PORT on exit, because the I/O file keeps its
+	contents across runs.
+
+	Telemetry goes the other way. Once the program sent READY, the
+	device publishes the rocket state every frame as TELEMETRY_WORDS
+	signed 16 bit little endian words from TELEMETRY_BASE_PORT, so word
+	w can be read with `in ax, TELEMETRY_PORT(w)`. The block is written
+	in one go between two writes of TELEMETRY_SEQUENCE, which is odd
+	while the block is being written and even once it is complete. To
+	read a consistent frame the program reads the sequence, skips the
+	frame if it is odd, reads the words it needs and reads the sequence
+	again. If it changed, the frame was torn and has to be read again.
+	A new even sequence also means a new frame. When there is no frame
+	at all, before the first one and after the device stopped, the
+	sequence is TELEMETRY_NO_FRAME, which is odd as well, so a reader
+	that starts with an odd last sequence never takes an empty block
+	for a frame.
+
+	All port numbers are relative to the protocol's portBase, so several
+	programs can share one device file, each in its own port range.
+*/
+#pragma once
+
+#include "virtual.h"
+
+#define COMMAND_PORT   10
+#define STATUS_PORT    11
+#define PROTOCOL_PORT  12
+#define RING_HEAD_PORT 13 // Next slot the program writes
+#define RING_TAIL_PORT 14 // Next slot the device reads
+#define RING_BASE_PORT 16
+#define RING_SIZE      16 // Power of two that divides 256
+#define RING_MASK      (RING_SIZE - 1)
+#define TELEMETRY_BASE_PORT 32
+#define TELEMETRY_PORT(word) (TELEMETRY_BASE_PORT + 2 * (word))
+
+#define PROTOCOL_VERSION_LEGACY 1
+#define PROTOCOL_VERSION_RING   2
+
+enum Status {
+    NOT_READY = 0,
+    READY = 69,             // Initial ready set by the emulator
+    COMMAND_NOT_READY = 99, // Not ready to execute the next command (check from asm before setting command)
+    COMMAND_READY = 100,    // Ready to execute the next command
+};
+
+// Words of the telemetry block. Directions are screen directions, x to
+// the right and y down.
+enum TelemetryWord {
+    TELEMETRY_SEQUENCE,        // Odd while the block is being written
+    TELEMETRY_STEP,            // Simulation step, low 16 bits
+    TELEMETRY_ROCKET_X,        // Pixels
+    TELEMETRY_ROCKET_Y,
+    TELEMETRY_VELOCITY_X,      // Movement per step, 1/256 pixel
+    TELEMETRY_VELOCITY_Y,
+    TELEMETRY_HEADING_X,       // Unit vector the nose points along, times 256
+    TELEMETRY_HEADING_Y,
+    TELEMETRY_ROTATION,        // Degrees 0..359, clockwise from up
+    TELEMETRY_ACCELERATION,    // 1/100, each ACCEL_POS adds 2
+    TELEMETRY_METEOR_DX,       // Nearest meteor centre minus rocket, pixels,
+    TELEMETRY_METEOR_DY,       // the short way around the screen edges
+    TELEMETRY_METEOR_DISTANCE, // Pixels, 7FFFh when there are no meteors
+    TELEMETRY_METEOR_RADIUS,   // Collision radius, pixels
+    TELEMETRY_METEOR_COUNT,
+    TELEMETRY_WORDS,
+};
+
+#define TELEMETRY_SIZE (2 * TELEMETRY_WORDS) // Bytes
+#define TELEMETRY_NO_FRAME 1 // Odd sequence of a block with no frame in it
+
+// Ports used by one program, the stride between two port ranges
+#define PROTOCOL_PORT_COUNT 64
+
+typedef struct PortProtocol {
+    VirtualDevice *device;
+    long portBase;      // Added to every port number above
+    int version;        // PROTOCOL_VERSION_*
+    unsigned char tail; // Device copy of RING_TAIL_PORT
+    int readyWindowUs;  // Legacy: longest COMMAND_READY is shown per call, 0 for one read
+} PortProtocol;
+
+// True once the program in the port range at portBase sent READY
+bool port_program_ready(VirtualDevice *device, long portBase = 0);
+
+// Read the version the program asked for. Call after READY was seen.
+// In legacy mode this also sets COMMAND_READY.
+void init_port_protocol(PortProtocol *protocol, VirtualDevice *device = &ioDevice, long portBase = 0);
+// Put the ports back into the state a fresh legacy program expects
+void free_port_protocol(PortProtocol *protocol);
+
+// Copy up to maxCommands pending commands into commands and return how
+// many were copied. Legacy mode takes at most two, the one left from the
+// last call and one written while COMMAND_READY was shown. Never blocks.
+int receive_port_commands(PortProtocol *protocol, unsigned char *commands, int maxCommands);
@@ -0,0 +1,137 @@
+#include "profiler.h"
+
+#if defined(ROCKET_PROFILER)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#define TRACE_ERR "Cannot write trace %s\n"
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {
+    "frame",
+    "port input",
+    "collision",
+    "meteor update",
+    "background",
+    "meteor draw",
+    "hud",
+    "present",
+};
+
+typedef struct TraceEvent {
+    uint64_t startNs;
+    uint64_t durationNs;
+    ProfilePhase phase;
+} TraceEvent;
+
+typedef struct Profiler {
+    std::chrono::steady_clock::time_point epoch;
+    uint64_t frameNs[PHASE_COUNT];                    // Summed over the current frame
+    float historyMs[PHASE_COUNT][PROFILE_HISTORY];    // Ring of finished frames
+    int historyCount;
+    int historyNext;
+    int framesSinceStats;
+    PhaseStats stats[PHASE_COUNT];
+    const char *tracePath;
+    std::vector<TraceEvent> trace;
+} Profiler;
+
+static Profiler profiler;
+// Set on the thread that called init_profiler, every other thread is ignored
+static thread_local bool profileThisThread = false;
+
+void init_profiler(const char *tracePath) {
+    profiler.epoch = std::chrono::steady_clock::now();
+    std::fill(profiler.frameNs, profiler.frameNs + PHASE_COUNT, 0);
+    profiler.historyCount = 0;
+    profiler.historyNext = 0;
+    profiler.framesSinceStats = 0;
+    std::fill(profiler.stats, profiler.stats + PHASE_COUNT, PhaseStats{ 0.0, 0.0 });
+    profiler.tracePath = tracePath;
+    profiler.trace.clear();
+    // Reserve up front so recording never allocates inside the frame loop
+    if (tracePath != nullptr)
+        profiler.trace.reserve(PROFILE_MAX_TRACE_EVENTS);
+    profileThisThread = true;
+}
+
+static void write_trace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, TRACE_ERR, path);
+        return;
+    }
+    // Complete ("X") events, timestamps in microseconds
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < profiler.trace.size(); i++) {
+        const TraceEvent &event = profiler.trace[i];
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"rocket\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                i == 0 ? "" : ",\n", PHASE_NAMES[event.phase], event.startNs / 1000.0, event.durationNs / 1000.0);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
+
+void free_profiler() {
+    if (profiler.tracePath != nullptr)
+        write_trace(profiler.tracePath);
+    profiler.tracePath = nullptr;
+    std::vector<TraceEvent>().swap(profiler.trace);
+    profileThisThread = false;
+}
+
+uint64_t profile_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler.epoch).count();
+}
+
+void profile_record(ProfilePhase phase, uint64_t startNs, uint64_t endNs) {
+    if (!profileThisThread)
+        return;
+    profiler.frameNs[phase] += endNs - startNs;
+    if (profiler.tracePath != nullptr && profiler.trace.size() < PROFILE_MAX_TRACE_EVENTS)
+        profiler.trace.push_back(TraceEvent{ startNs, endNs - startNs, phase });
+}
+
+static void update_stats() {
+    float sorted[PROFILE_HISTORY];
+    const int count = profiler.historyCount;
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        std::copy(profiler.historyMs[phase], profiler.historyMs[phase] + count, sorted);
+        std::nth_element(sorted, sorted + count / 2, sorted + count);
+        profiler.stats[phase].p50Ms = sorted[count / 2];
+        int p99 = std::min(count - 1, count * 99 / 100);
+        std::nth_element(sorted, sorted + p99, sorted + count);
+        profiler.stats[phase].p99Ms = sorted[p99];
+    }
+}
+
+void profile_end_frame() {
+    if (!profileThisThread)
+        return;
+    // Nothing was timed (first loop iteration), keep the history clean
+    if (std::all_of(profiler.frameNs, profiler.frameNs + PHASE_COUNT, [](uint64_t ns) { return ns == 0; }))
+        return;
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        profiler.historyMs[phase][profiler.historyNext] = profiler.frameNs[phase] / 1e6f;
+        profiler.frameNs[phase] = 0;
+    }
+    profiler.historyNext = (profiler.historyNext + 1) % PROFILE_HISTORY;
+    profiler.historyCount = std::min(profiler.historyCount + 1, PROFILE_HISTORY);
+
+    if (++profiler.framesSinceStats >= PROFILE_STATS_INTERVAL) {
+        profiler.framesSinceStats = 0;
+        update_stats();
+    }
+}
+
+PhaseStats profile_phase_stats(ProfilePhase phase) {
+    return profiler.stats[phase];
+}
+
+const char *profile_phase_name(ProfilePhase phase) {
+    return PHASE_NAMES[phase];
+}
+
+#endif
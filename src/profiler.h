@@ -0,0 +1,78 @@
+/*
+	Per-phase frame profiler. PROFILE_SCOPE(phase) times the rest of
+	the enclosing block. Time spent in each phase is summed per frame,
+	and profile_end_frame pushes the sums into a rolling history of the
+	last PROFILE_HISTORY frames, from which p50/p99 are computed. With a
+	trace path, every scope is also kept as a complete event and written
+	as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) by
+	free_profiler.
+
+	Only the thread that called init_profiler is timed. Everything is
+	compiled out unless ROCKET_PROFILER is defined. PROFILE_SCOPE then
+	expands to nothing and the functions become empty inlines.
+
+	Draw phases measure CPU time to submit work. raylib batches draws,
+	so GPU time shows up wherever the batch is flushed, mostly PRESENT.
+*/
+#pragma once
+
+#include <cstdint>
+
+#define PROFILE_HISTORY 256              // Frames the percentiles cover
+#define PROFILE_STATS_INTERVAL 30        // Frames between percentile updates
+#define PROFILE_MAX_TRACE_EVENTS 1000000 // Events kept for the trace file
+
+enum ProfilePhase {
+    PHASE_FRAME,
+    PHASE_PORT_INPUT,    // Draining the command queue from the I/O thread
+    PHASE_COLLISION,     // Broad phase and collision response
+    PHASE_METEOR_UPDATE, // Integrate, damp, wrap
+    PHASE_BACKGROUND,    // Star and noise shader passes
+    PHASE_METEOR_DRAW,
+    PHASE_HUD,           // DrawTextEx debug text
+    PHASE_PRESENT,       // EndDrawing: batch flush, swap, frame cap
+    PHASE_COUNT,
+};
+
+typedef struct PhaseStats {
+    double p50Ms;
+    double p99Ms;
+} PhaseStats;
+
+#if defined(ROCKET_PROFILER)
+
+// Start timing the calling thread. tracePath may be null for no trace.
+void init_profiler(const char *tracePath = nullptr);
+// Write the trace file, if any, and release the buffers
+void free_profiler();
+
+uint64_t profile_now_ns();
+void profile_record(ProfilePhase phase, uint64_t startNs, uint64_t endNs);
+void profile_end_frame();
+// Percentiles of per-frame time as of the last update
+PhaseStats profile_phase_stats(ProfilePhase phase);
+const char *profile_phase_name(ProfilePhase phase);
+
+struct ProfileScope {
+    ProfilePhase phase;
+    uint64_t startNs;
+
+    explicit ProfileScope(ProfilePhase phase) : phase(phase), startNs(profile_now_ns()) {}
+    ~ProfileScope() { profile_record(phase, startNs, profile_now_ns()); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(phase)
+
+#else
+
+inline void init_profiler(const char * = nullptr) {}
+inline void free_profiler() {}
+inline void profile_end_frame() {}
+inline PhaseStats profile_phase_stats(ProfilePhase) { return PhaseStats{ 0.0, 0.0 }; }
+inline const char *profile_phase_name(ProfilePhase) { return ""; }
+
+#define PROFILE_SCOPE(phase)
+
+#endif
@@ -0,0 +1,29 @@
+#version 330
+
+// Unit quad corner (-0.5..0.5) and its texture coordinate
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+
+// Per-meteor attributes (advance once per instance)
+in float instancePositionX;
+in float instancePositionY;
+in float instanceScale;
+in float instanceRotation;   // Radians, clockwise on screen
+
+uniform mat4 mvp;
+uniform vec2 spriteSize;
+
+out vec2 fragTexCoord;
+out vec4 fragColor;
+
+void main() {
+    vec2 local = vertexPosition.xy * spriteSize * instanceScale;
+    float c = cos(instanceRotation);
+    float s = sin(instanceRotation);
+    vec2 world = vec2(local.x * c - local.y * s, local.x * s + local.y * c)
+               + vec2(instancePositionX, instancePositionY);
+
+    fragTexCoord = vertexTexCoord;
+    fragColor = vec4(1.0);
+    gl_Position = mvp * vec4(world, 0.0, 1.0);
+}
@@ -4,9 +4,25 @@
 
 name "rocket"
 
-; Port value constants
-COMMAND_PORT equ 10
-STATUS_PORT  equ 11
+; Port value constants (see port_protocol.h)
+COMMAND_PORT   equ 10
+STATUS_PORT    equ 11
+PROTOCOL_PORT  equ 12
+RING_HEAD_PORT equ 13 ; Written by us: next free slot
+RING_TAIL_PORT equ 14 ; Written by the device: next slot it reads
+RING_BASE_PORT equ 16
+RING_SIZE      equ 16
+RING_MASK      equ 0Fh
+
+PROTOCOL_VERSION_RING equ 2
+
+; Use the command ring (protocol v2). Both indices start at zero and the
+; version is set before READY, so the device sees it on its first read.
+mov al, 0
+out RING_HEAD_PORT, al
+out RING_TAIL_PORT, al
+mov al, PROTOCOL_VERSION_RING
+out PROTOCOL_PORT, al
 
 ; Write 69 into status port (11) to specify that emulator is ready
 ; to the virtual device. Device waits to see the status number
@@ -20,20 +36,32 @@ call print_msg
 ; w = 77h s = 73h d = 64h a = 61h
 ; Main function of the program (looped infinitely otherwise stated)
 main:
-    ; Interrupt to scan a code from keyboard (wasd)
+    ; Interrupt to scan a code from keyboard (wasd), waits for a key
     mov ah, 0
     int 16h
-    
-    ; Character code saved in al. Save in stack before
-    ; calling wait_until_ready which needs `al` register
-    push ax
-    ; Device will set the COMMAND_READY when it's finished executing the last frame and ready 
-    ; to accept new commands for the new frame. Not an huge issue, but in case a frame takes longer
-    ; time to render we will wait so that the command is disregarded.
-    call wait_until_ready
-    pop ax
-     
-    ; Jump to correct sub-routine based on key (if-conditonals) 
+    call queue_key
+
+    ; Queue every key that is already waiting in the keyboard buffer
+    ; too, without blocking, so a burst of keys goes out as one batch
+drain_keys:
+    mov ah, 1
+    int 16h
+    jz publish  ; ZF set: no more keys
+    mov ah, 0
+    int 16h
+    call queue_key
+    jmp drain_keys
+
+    ; A single write of head hands the whole batch to the device. The
+    ; device drains all published commands every step, so nothing here
+    ; waits for a frame unless the ring is full.
+publish:
+    call publish_commands
+    jmp main
+
+; Map the key in `al` to a command, queue it and print what it does.
+; Any key other than wasd exits.
+queue_key proc
     cmp al, 77h ; Pressed `w`
     jz increase_thrust
     cmp al, 73h ; Pressed `s`
@@ -42,53 +70,77 @@ main:
     jz rotate_right
     cmp al, 61h ; Pressed `a`
     jz rotate_left
-    
+
     ; If any other character pressed then exit!
+    pop ax ; Drop the return address, `end` never returns
     jmp end
-    
-    
-jmp main
-jmp end
 
-; Send 0x1 from COMMAND_PORT to increase acceleration
+; Queue 0x1 to increase acceleration
 increase_thrust:
     mov al, 1h
-    out COMMAND_PORT, al
+    call push_command
     mov dx, offset thrust_msg
     call print_msg
-    jmp main
-    
-; Send 0x2 from COMMAND_PORT to decrease acceleration
+    ret
+
+; Queue 0x2 to decrease acceleration
 decrease_thrust:
     mov al, 2h
-    out COMMAND_PORT, al
+    call push_command
     mov dx, offset dethrust_msg
     call print_msg
-    jmp main
+    ret
 
-; Send 0x3 from COMMAND_PORT to rotate right
+; Queue 0x3 to rotate right
 rotate_right:
     mov al, 3h
-    out COMMAND_PORT, al
+    call push_command
     mov dx, offset rotate_right_msg
     call print_msg
-    jmp main
+    ret
 
-; Send 0x4 from COMMAND_PORT to rotate left
+; Queue 0x4 to rotate left
 rotate_left:
     mov al, 4h
-    out COMMAND_PORT, al
+    call push_command
     mov dx, offset rotate_left_msg
     call print_msg
-    jmp main
-             
-             
-wait_until_ready proc
-busy: in al, STATUS_PORT
-      cmp al, 64h ; 100
-      jnz busy    ; busy, so wait.
-ret    
-wait_until_ready endp
+    ret
+queue_key endp
+
+; Write the command in `al` into the next ring slot. Does not publish it.
+; If the ring is full, publish what we have and wait for the device.
+push_command proc
+    push bx
+    push dx
+    mov bl, al
+wait_for_slot:
+    in al, RING_TAIL_PORT
+    mov ah, ring_head
+    sub ah, al        ; Commands in flight (mod 256)
+    cmp ah, RING_SIZE
+    jb slot_free
+    call publish_commands
+    jmp wait_for_slot
+slot_free:
+    mov al, ring_head
+    and al, RING_MASK
+    mov dx, RING_BASE_PORT
+    add dl, al        ; RING_BASE_PORT + (head & RING_MASK), never carries
+    mov al, bl
+    out dx, al
+    inc ring_head
+    pop dx
+    pop bx
+    ret
+push_command endp
+
+; Make every slot written so far visible to the device
+publish_commands proc
+    mov al, ring_head
+    out RING_HEAD_PORT, al
+    ret
+publish_commands endp
 
 ; Need to set start offset to msg in dx before calling print_msg
 ; mov dx, offset msg
@@ -98,6 +150,9 @@ int 21h
 ret
 print_msg endp
 
+; Free running copy of RING_HEAD_PORT
+ring_head db 0
+
 ; Strings
 helper_msg db       "Use WASD keys for controlling the rocket. Press any other key to exit!", 0dh,0ah, "$"
 thrust_msg db       "Pressed (w) -> Increasing thrust", 0Dh,0Ah, "$"
@@ -107,10 +162,12 @@ rotate_left_msg db  "Pressed (a) -> Rotating left",     0Dh,0Ah, "$"
 exit_msg db         "Shutting down device. Exiting!",   0Dh,0Ah, "$"
 
 
-; End procedure. Perform de-initialization of virtual device properly
+; End procedure. Perform de-initialization of virtual device properly.
+; EXIT goes through the ring behind any commands still queued.
 end:
 mov dx, offset exit_msg
 call print_msg
 mov al, 5h ; 0x5 is Command::EXIT
-out COMMAND_PORT, al
+call push_command
+call publish_commands
 hlt
@@ -0,0 +1,57 @@
+/*
+	Random numbers for the simulation. Each Simulation owns its own
+	generator, so spawning does not depend on raylib's global one and
+	several simulations can be set up at once on different threads.
+
+	Same algorithm and seeding as raylib's GetRandomValue (rprand:
+	SplitMix64 seeding xoshiro128**), so a seed spawns exactly the
+	meteors it did when the simulation used GetRandomValue, and old
+	command logs still replay.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+typedef struct SimRandom {
+    uint64_t seed;     // SplitMix64 state, only used while seeding
+    uint32_t state[4]; // xoshiro128** state
+} SimRandom;
+
+inline uint64_t sim_random_splitmix64(SimRandom *random) {
+    uint64_t z = (random->seed += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+inline void seed_sim_random(SimRandom *random, uint64_t seed) {
+    random->seed = seed;
+    random->state[0] = (uint32_t)(sim_random_splitmix64(random) & 0xffffffff);
+    random->state[1] = (uint32_t)((sim_random_splitmix64(random) & 0xffffffff00000000) >> 32);
+    random->state[2] = (uint32_t)(sim_random_splitmix64(random) & 0xffffffff);
+    random->state[3] = (uint32_t)((sim_random_splitmix64(random) & 0xffffffff00000000) >> 32);
+}
+
+inline uint32_t sim_random_next(SimRandom *random) {
+    uint32_t *s = random->state;
+    const uint32_t result = ((s[1] * 5) << 7 | (s[1] * 5) >> 25) * 9;
+    const uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 11) | (s[3] >> 21);
+    return result;
+}
+
+// Value in [min, max], both included, like GetRandomValue
+inline int sim_random_value(SimRandom *random, int min, int max) {
+    if (min > max) {
+        int tmp = max;
+        max = min;
+        min = tmp;
+    }
+    return sim_random_next(random) % (abs(max - min) + 1) + min;
+}
@@ -0,0 +1,559 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include "profiler.h"
+#include "simulation.h"
+
+// Grid rows per collision job and meteors per integration job
+#define COLLISION_ROWS_PER_JOB 1
+#define INTEGRATION_METEORS_PER_JOB 4096
+
+// Append a meteor at position heading roughly towards the rocket.
+// Draws from sim->random in the order the original spawn loop did.
+static MeteorHandle add_meteor(Simulation *sim, Vector2 position) {
+    MeteorField *meteors = &sim->meteors;
+    const int i = meteors->count;
+    if (!add_meteor_slot(&sim->pool, i, sim->steps))
+        return NULL_METEOR_HANDLE;
+
+    SimRandom *random = &sim->random;
+    Vector2 velocity = Vector2Subtract(sim->rocket.position, position);
+    velocity.x += sim_random_value(random, -5, 5);
+    velocity.y += sim_random_value(random, -5, 5);
+    velocity = Vector2Normalize(velocity);
+
+    // Storage was reserved with the pool, so this never reallocates
+    meteors->count = i + 1;
+    sim->meteorsNext.count = i + 1;
+    meteors->positionX[i] = position.x;
+    meteors->positionY[i] = position.y;
+    meteors->velocityX[i] = velocity.x;
+    meteors->velocityY[i] = velocity.y;
+    // 0 to METEOR_MAX_RADIUS, the grid's cell size depends on the upper end
+    meteors->radius[i] = (float)sim_random_value(random, 0.5, 2.0);
+    // Radius never changes, both buffers carry it
+    sim->meteorsNext.radius[i] = meteors->radius[i];
+    return meteor_handle(&sim->pool, i);
+}
+
+// Meteors wrap over [-METEOR_SPRITE_SIZE, size + METEOR_SPRITE_SIZE]
+static inline float wrap_extent(int size) {
+    return size + 2 * METEOR_SPRITE_SIZE;
+}
+
+// Split the play area into cells of at least METEOR_GRID_CELL_SIZE and
+// allocate the per cell arrays. The size does not depend on which
+// meteors are alive, so the grid keeps its shape and storage for the
+// whole session. Leaves no columns when the area is too small for a 3x3
+// grid.
+static void layout_meteor_grid(Simulation *sim) {
+    MeteorGrid *grid = &sim->grid;
+    const float extentX = wrap_extent(sim->width);
+    const float extentY = wrap_extent(sim->height);
+    grid->columns = (int)(extentX / METEOR_GRID_CELL_SIZE);
+    grid->rows = (int)(extentY / METEOR_GRID_CELL_SIZE);
+    if (grid->columns < 3 || grid->rows < 3) {
+        grid->columns = 0;
+        grid->rows = 0;
+        grid->cellStart.clear();
+        grid->cellCursor.reset();
+        return;
+    }
+    grid->cellWidth = extentX / grid->columns;
+    grid->cellHeight = extentY / grid->rows;
+
+    const int cellCount = grid->columns * grid->rows;
+    grid->cellStart.assign(cellCount + 1, 0);
+    grid->cellCursor.reset(new std::atomic<int>[cellCount]);
+}
+
+// The per meteor arrays of the grid, for capacity meteors
+static void reserve_meteor_grid(MeteorGrid *grid, int capacity) {
+    grid->cellMeteors.reserve(capacity);
+    grid->meteorCell.reserve(capacity);
+}
+
+void init_simulation(Simulation *sim, int width, int height, int meteorCount, uint32_t seed) {
+    seed_sim_random(&sim->random, seed);
+    sim->width = width;
+    sim->height = height;
+    sim->rocket = Rocket{0.0};
+    sim->rocket.position = Vector2{width/2.0f, height/2.0f};
+    sim->spawn = MeteorSpawn{};
+    sim->steps = 0;
+    layout_meteor_grid(sim);
+
+    meteorCount = std::clamp(meteorCount, 0, MAX_METEORS);
+    for (MeteorField *field : { &sim->meteors, &sim->meteorsNext }) {
+        reserve_meteor_field(field, meteorCount);
+        resize_meteor_field(field, 0);
+    }
+    reserve_meteor_pool(&sim->pool, meteorCount);
+    clear_meteor_pool(&sim->pool);
+    reserve_meteor_grid(&sim->grid, meteorCount);
+
+    SimRandom *random = &sim->random;
+    for (int i = 0; i < meteorCount; i++) {
+        Vector2 spawnPosition = Vector2{
+            (float)sim_random_value(random, 0, width),
+            (float)sim_random_value(random, -1, 1) * height
+        };
+        add_meteor(sim, spawnPosition);
+    }
+}
+
+void free_simulation(Simulation *sim) {
+    free_meteor_field(&sim->meteors);
+    free_meteor_field(&sim->meteorsNext);
+    sim->pool = MeteorPool{};
+}
+
+void set_meteor_spawn(Simulation *sim, const MeteorSpawn *spawn) {
+    sim->spawn = *spawn;
+    sim->spawn.maxMeteors = std::clamp(spawn->maxMeteors, 0, MAX_METEORS);
+    const int capacity = std::max(sim->spawn.maxMeteors, sim->meteors.count);
+    reserve_meteor_field(&sim->meteors, capacity);
+    reserve_meteor_field(&sim->meteorsNext, capacity);
+    reserve_meteor_pool(&sim->pool, capacity);
+    reserve_meteor_grid(&sim->grid, capacity);
+}
+
+MeteorHandle spawn_meteor(Simulation *sim) {
+    SimRandom *random = &sim->random;
+    // Just outside a random edge, so the meteor flies in instead of popping up
+    const float margin = METEOR_SPRITE_SIZE / 2;
+    Vector2 position;
+    switch (sim_random_value(random, 0, 3)) {
+    case 0:  position = Vector2{ (float)sim_random_value(random, 0, sim->width), -margin }; break;
+    case 1:  position = Vector2{ (float)sim_random_value(random, 0, sim->width), sim->height + margin }; break;
+    case 2:  position = Vector2{ -margin, (float)sim_random_value(random, 0, sim->height) }; break;
+    default: position = Vector2{ sim->width + margin, (float)sim_random_value(random, 0, sim->height) }; break;
+    }
+    return add_meteor(sim, position);
+}
+
+static void remove_meteor_at(Simulation *sim, int i) {
+    remove_meteor_slot(&sim->pool, i, sim->meteors.count - 1);
+    remove_meteor(&sim->meteors, i);
+    remove_meteor(&sim->meteorsNext, i);
+}
+
+void despawn_meteor(Simulation *sim, MeteorHandle handle) {
+    int i = meteor_index(&sim->pool, handle);
+    if (i >= 0)
+        remove_meteor_at(sim, i);
+}
+
+void apply_command(Rocket *rocket, int command) {
+    switch (command) {
+    case Command::ACCEL_POS:
+        rocket->acceleration += ROCKET_ACCELRATION;
+        break;
+    case Command::ACCEL_NEG:
+        rocket->acceleration -= ROCKET_ACCELRATION;
+        break;
+    case Command::ROTATE_RIGHT:
+        rocket->rotation += ROCKET_ROTATION_SPEED;
+        break;
+    case Command::ROTATE_LEFT:
+        rocket->rotation -= ROCKET_ROTATION_SPEED;
+        break;
+    default:
+        break;
+    }
+}
+
+// Same test as raylib's CheckCollisionCircles, kept bit for bit so
+// recorded sessions replay, without linking the raylib runtime
+static inline bool circles_overlap(Vector2 center1, float radius1, Vector2 center2, float radius2) {
+    float dx = center2.x - center1.x;
+    float dy = center2.y - center1.y;
+    return sqrtf(dx * dx + dy * dy) <= radius1 + radius2;
+}
+
+static void update_rocket(Simulation *sim) {
+    Rocket *rocket = &sim->rocket;
+    const int width = sim->width;
+    const int height = sim->height;
+
+    // Calculate velocity of rocket relative to the rotation
+    rocket->velocity.x = sin(rocket->rotation * DEG2RAD) * ROCKET_SPEED;
+    rocket->velocity.y = cos(rocket->rotation * DEG2RAD) * ROCKET_SPEED;
+
+    // Update position with velocity and acceleration
+    rocket->position.x += (rocket->velocity.x * rocket->acceleration);
+    rocket->position.y -= (rocket->velocity.y * rocket->acceleration);
+
+    // Keep the rocket within screen bounds
+    int rocketHeight = rocket_draw_size();
+    if (rocket->position.x > width + rocketHeight)
+        rocket->position.x = -rocketHeight;
+    else if (rocket->position.x < -rocketHeight)
+        rocket->position.x = width + rocketHeight;
+    if (rocket->position.y > height + rocketHeight)
+        rocket->position.y = -rocketHeight;
+    else if (rocket->position.y < -rocketHeight)
+        rocket->position.y = height + rocketHeight;
+}
+
+// Original all-pairs loop. Every pair is visited as (i, j) and (j, i) so
+// the response is applied twice and depends on iteration order.
+static void collide_meteors_all_pairs(Simulation *sim) {
+    PROFILE_SCOPE(PHASE_COLLISION);
+    Rocket *rocket = &sim->rocket;
+    MeteorField *meteors = &sim->meteors;
+    const int meteorCount = meteors->count;
+    const float rocketRadius = rocket_draw_size() / 2 - 10.0f;
+
+    for (int i = 0; i < meteorCount; i++) {
+        // With rocket
+        bool isColliding = circles_overlap(meteor_position(meteors, i), meteors->radius[i] * METEOR_COLLISION_RADIUS, rocket->position, rocketRadius);
+        if (isColliding) {
+            Vector2 norm = Vector2Normalize(rocket->velocity);
+            if (fabsf(rocket->acceleration) < 0.20) {
+                meteors->velocityX[i] =  -0.5 * meteors->velocityX[i];
+                meteors->velocityY[i] =  -0.5 * meteors->velocityY[i];
+            } else {
+                meteors->velocityX[i] +=  norm.x * rocket->acceleration * METEOR_ROCKET_COLLISION_DAMPING;
+                meteors->velocityY[i] +=  -1 * norm.y * rocket->acceleration * METEOR_ROCKET_COLLISION_DAMPING;
+            }
+        }
+
+        // With other meteors
+        for (int j = 0; j < meteorCount; j++) {
+            // No need to check collision for itself
+            if (i == j)
+                continue;
+            bool isColliding = circles_overlap(meteor_position(meteors, i), meteors->radius[i] * METEOR_COLLISION_RADIUS, meteor_position(meteors, j), meteors->radius[j] * METEOR_COLLISION_RADIUS);
+            if (isColliding) {
+                // Change direction of meteor after collision relative to size
+                Vector2 tempMeteor1Vel = meteor_velocity(meteors, j);
+                meteors->velocityX[j] += meteors->velocityX[i] * meteors->radius[i] * METEOR_COLLISION_DAMPING ;
+                meteors->velocityY[j] += meteors->velocityY[i] * meteors->radius[i] * METEOR_COLLISION_DAMPING ;
+                meteors->velocityX[i] +=  tempMeteor1Vel.x * meteors->radius[j] * METEOR_COLLISION_DAMPING;
+                meteors->velocityY[i] +=  tempMeteor1Vel.y * meteors->radius[j] * METEOR_COLLISION_DAMPING;
+            }
+        }
+    }
+}
+
+static inline int wrap_cell(int cell, int count) {
+    return ((cell % count) + count) % count;
+}
+
+// Shortest distance along one axis when the play area wraps around
+static inline float wrap_delta(float delta, float extent) {
+    if (delta > extent / 2)
+        return delta - extent;
+    if (delta < -extent / 2)
+        return delta + extent;
+    return delta;
+}
+
+static inline int meteor_grid_cell(const MeteorGrid *grid, const MeteorField *meteors, int i) {
+    int cx = wrap_cell((int)floorf((meteors->positionX[i] + METEOR_SPRITE_SIZE) / grid->cellWidth), grid->columns);
+    int cy = wrap_cell((int)floorf((meteors->positionY[i] + METEOR_SPRITE_SIZE) / grid->cellHeight), grid->rows);
+    return cy * grid->columns + cx;
+}
+
+// Bucket meteors into the cells of layout_meteor_grid. Returns false
+// when there are none, in which case the caller falls back to testing
+// all pairs.
+//
+// In deterministic mode this is a serial stable counting sort, so the
+// order inside a cell (and therefore the order collision responses are
+// summed in) is the same for any thread count. Otherwise cells are
+// filled in parallel with atomic cursors and that order may vary.
+static bool build_meteor_grid(Simulation *sim) {
+    MeteorGrid *grid = &sim->grid;
+    const MeteorField *meteors = &sim->meteors;
+    const int meteorCount = meteors->count;
+    if (grid->columns == 0)
+        return false;
+
+    // All of this was allocated up front, none of it reallocates
+    const int cellCount = grid->columns * grid->rows;
+    grid->cellMeteors.resize(meteorCount);
+    grid->meteorCell.resize(meteorCount);
+
+    if (sim->deterministic || sim->jobs == nullptr) {
+        // Counting sort by cell, keeping meteors in index order inside a cell
+        std::fill(grid->cellStart.begin(), grid->cellStart.end(), 0);
+        for (int i = 0; i < meteorCount; i++) {
+            int cell = meteor_grid_cell(grid, meteors, i);
+            grid->meteorCell[i] = cell;
+            grid->cellStart[cell]++;
+        }
+        int offset = 0;
+        for (int cell = 0; cell < cellCount; cell++) {
+            int count = grid->cellStart[cell];
+            grid->cellStart[cell] = offset;
+            offset += count;
+        }
+        grid->cellStart[cellCount] = offset;
+        for (int i = 0; i < meteorCount; i++)
+            grid->cellMeteors[grid->cellStart[grid->meteorCell[i]]++] = i;
+        // Scattering moved every start to the start of the next cell
+        for (int cell = cellCount - 1; cell > 0; cell--)
+            grid->cellStart[cell] = grid->cellStart[cell - 1];
+        grid->cellStart[0] = 0;
+        return true;
+    }
+
+    std::atomic<int> *cursor = grid->cellCursor.get();
+    for (int cell = 0; cell < cellCount; cell++)
+        cursor[cell].store(0, std::memory_order_relaxed);
+
+    parallel_for(sim->jobs, meteorCount, INTEGRATION_METEORS_PER_JOB, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int cell = meteor_grid_cell(grid, meteors, i);
+            grid->meteorCell[i] = cell;
+            cursor[cell].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    int offset = 0;
+    for (int cell = 0; cell < cellCount; cell++) {
+        grid->cellStart[cell] = offset;
+        offset += cursor[cell].load(std::memory_order_relaxed);
+        cursor[cell].store(grid->cellStart[cell], std::memory_order_relaxed);
+    }
+    grid->cellStart[cellCount] = offset;
+    parallel_for(sim->jobs, meteorCount, INTEGRATION_METEORS_PER_JOB, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            grid->cellMeteors[cursor[grid->meteorCell[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+    });
+    return true;
+}
+
+static inline bool touches_rocket(const Simulation *sim, const MeteorField *meteors, int i) {
+    const float rocketRadius = rocket_draw_size() / 2 - 10.0f;
+    return circles_overlap(meteor_position(meteors, i), meteors->radius[i] * METEOR_COLLISION_RADIUS, sim->rocket.position, rocketRadius);
+}
+
+// Velocity of meteor i after bumping into the rocket
+static inline Vector2 collide_with_rocket(const Simulation *sim, const MeteorField *current, int i, Vector2 rocketNorm) {
+    const Rocket *rocket = &sim->rocket;
+    Vector2 velocity = meteor_velocity(current, i);
+
+    if (touches_rocket(sim, current, i)) {
+        if (fabsf(rocket->acceleration) < 0.20) {
+            velocity.x =  -0.5 * velocity.x;
+            velocity.y =  -0.5 * velocity.y;
+        } else {
+            velocity.x +=  rocketNorm.x * rocket->acceleration * METEOR_ROCKET_COLLISION_DAMPING;
+            velocity.y +=  -1 * rocketNorm.y * rocket->acceleration * METEOR_ROCKET_COLLISION_DAMPING;
+        }
+    }
+    return velocity;
+}
+
+// Add the response of meteor i to every colliding meteor, for when
+// there is no grid. Only the current buffer is read, so the result does
+// not depend on which meteors ran before.
+static inline void collide_with_meteors(const Simulation *sim, const MeteorField *current, int i, Vector2 *velocity) {
+    const float extentX = wrap_extent(sim->width);
+    const float extentY = wrap_extent(sim->height);
+
+    for (int j = 0; j < current->count; j++) {
+        if (j == i)
+            continue;
+        float dx = wrap_delta(current->positionX[j] - current->positionX[i], extentX);
+        float dy = wrap_delta(current->positionY[j] - current->positionY[i], extentY);
+        float reach = (current->radius[i] + current->radius[j]) * METEOR_COLLISION_RADIUS;
+        if (dx * dx + dy * dy > reach * reach)
+            continue;
+        // Change direction relative to the size of the other meteor
+        velocity->x += current->velocityX[j] * current->radius[j] * METEOR_COLLISION_DAMPING;
+        velocity->y += current->velocityY[j] * current->radius[j] * METEOR_COLLISION_DAMPING;
+    }
+}
+
+// Cells a cell tests its meteors against, besides itself. Of any two
+// neighbouring cells only one has the other in here, so every pair of
+// meteors is tested once. All of them are in the same row or the next.
+static const int GRID_HALF_NEIGHBOURS[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+// If meteors i and j touch, add the response of each one to the other's
+// velocity in meteorsNext. Only the current buffer is read.
+static inline void collide_pair(const MeteorField *current, MeteorField *next, int i, int j, float extentX, float extentY) {
+    float dx = wrap_delta(current->positionX[j] - current->positionX[i], extentX);
+    float dy = wrap_delta(current->positionY[j] - current->positionY[i], extentY);
+    float reach = (current->radius[i] + current->radius[j]) * METEOR_COLLISION_RADIUS;
+    if (dx * dx + dy * dy > reach * reach)
+        return;
+    // Change direction relative to the size of the other meteor
+    next->velocityX[i] += current->velocityX[j] * current->radius[j] * METEOR_COLLISION_DAMPING;
+    next->velocityY[i] += current->velocityY[j] * current->radius[j] * METEOR_COLLISION_DAMPING;
+    next->velocityX[j] += current->velocityX[i] * current->radius[i] * METEOR_COLLISION_DAMPING;
+    next->velocityY[j] += current->velocityY[i] * current->radius[i] * METEOR_COLLISION_DAMPING;
+}
+
+// Test every pair that has a meteor in grid row cy against its own cell
+// and GRID_HALF_NEIGHBOURS. Writes meteors of rows cy and cy + 1 only.
+static void collide_grid_row(Simulation *sim, int cy) {
+    const MeteorGrid *grid = &sim->grid;
+    const MeteorField *current = &sim->meteors;
+    MeteorField *next = &sim->meteorsNext;
+    const int *cellMeteors = grid->cellMeteors.data();
+    const float extentX = wrap_extent(sim->width);
+    const float extentY = wrap_extent(sim->height);
+
+    for (int cx = 0; cx < grid->columns; cx++) {
+        int cell = cy * grid->columns + cx;
+        int cellEnd = grid->cellStart[cell + 1];
+        for (int a = grid->cellStart[cell]; a < cellEnd; a++) {
+            int i = cellMeteors[a];
+            for (int b = a + 1; b < cellEnd; b++)
+                collide_pair(current, next, i, cellMeteors[b], extentX, extentY);
+            for (const int *offset : GRID_HALF_NEIGHBOURS) {
+                int neighbour = wrap_cell(cy + offset[1], grid->rows) * grid->columns + wrap_cell(cx + offset[0], grid->columns);
+                for (int b = grid->cellStart[neighbour]; b < grid->cellStart[neighbour + 1]; b++)
+                    collide_pair(current, next, i, cellMeteors[b], extentX, extentY);
+            }
+        }
+    }
+}
+
+// Collision response for every meteor into meteorsNext, from the grid
+// when it can be built and from all pairs otherwise
+static void collide_meteors_grid(Simulation *sim) {
+    PROFILE_SCOPE(PHASE_COLLISION);
+    MeteorField *meteors = &sim->meteors;
+    const Vector2 rocketNorm = Vector2Normalize(sim->rocket.velocity);
+    if (build_meteor_grid(sim)) {
+        // Start from the response to the rocket, pairs add to it
+        parallel_for(sim->jobs, meteors->count, INTEGRATION_METEORS_PER_JOB, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Vector2 velocity = collide_with_rocket(sim, meteors, i, rocketNorm);
+                sim->meteorsNext.velocityX[i] = velocity.x;
+                sim->meteorsNext.velocityY[i] = velocity.y;
+            }
+        });
+        // A row writes its own meteors and those of the next row, so even
+        // and odd rows go in separate passes and no two jobs write the same
+        // meteor. With an odd row count the last row wraps onto row 0 and
+        // goes on its own. Every row runs on one thread in a fixed order,
+        // so the sums do not depend on the thread count.
+        const int rows = sim->grid.rows;
+        for (int parity = 0; parity < 2; parity++) {
+            parallel_for(sim->jobs, rows / 2, COLLISION_ROWS_PER_JOB, [&](int begin, int end) {
+                for (int k = begin; k < end; k++)
+                    collide_grid_row(sim, 2 * k + parity);
+            });
+        }
+        if (rows % 2 != 0)
+            collide_grid_row(sim, rows - 1);
+    } else {
+        parallel_for(sim->jobs, meteors->count, INTEGRATION_METEORS_PER_JOB / 16, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Vector2 velocity = collide_with_rocket(sim, meteors, i, rocketNorm);
+                collide_with_meteors(sim, meteors, i, &velocity);
+                sim->meteorsNext.velocityX[i] = velocity.x;
+                sim->meteorsNext.velocityY[i] = velocity.y;
+            }
+        });
+    }
+}
+
+void collide_meteors(Simulation *sim) {
+    if (sim->broadPhase == BROAD_PHASE_ALL_PAIRS)
+        collide_meteors_all_pairs(sim);
+    else
+        collide_meteors_grid(sim);
+}
+
+// Despawn expired meteors and those that hit the rocket, then spawn a
+// wave when one is due. Costs nothing while sim->spawn is all zero.
+static void update_meteor_churn(Simulation *sim) {
+    const MeteorSpawn *spawn = &sim->spawn;
+    if (spawn->lifetime > 0 || spawn->destroyOnHit) {
+        // Backwards, so the meteor moved into a hole was already checked
+        for (int i = sim->meteors.count - 1; i >= 0; i--) {
+            bool expired = spawn->lifetime > 0 && sim->steps - meteor_spawn_step(&sim->pool, i) >= (uint64_t)spawn->lifetime;
+            if (expired || (spawn->destroyOnHit && touches_rocket(sim, &sim->meteors, i)))
+                remove_meteor_at(sim, i);
+        }
+    }
+    if (spawn->waveInterval > 0 && sim->steps % spawn->waveInterval == 0) {
+        for (int n = 0; n < spawn->waveSize && sim->meteors.count < spawn->maxMeteors; n++) {
+            if (spawn_meteor(sim).slot == NO_METEOR_SLOT)
+                break;
+        }
+    }
+}
+
+void step_simulation(Simulation *sim) {
+    MeteorField *meteors = &sim->meteors;
+    const float minX = -METEOR_SPRITE_SIZE, maxX = sim->width + METEOR_SPRITE_SIZE;
+    const float minY = -METEOR_SPRITE_SIZE, maxY = sim->height + METEOR_SPRITE_SIZE;
+
+    update_rocket(sim);
+    collide_meteors(sim);
+
+    if (sim->broadPhase == BROAD_PHASE_ALL_PAIRS) {
+        // Original single threaded path, updates the meteors in place
+        PROFILE_SCOPE(PHASE_METEOR_UPDATE);
+        integrate_meteors(meteors, meteors, 0, meteors->count, minX, maxX, minY, maxY);
+    } else {
+        // Dampen asteroids over time and wrap them at the walls
+        PROFILE_SCOPE(PHASE_METEOR_UPDATE);
+        parallel_for(sim->jobs, meteors->count, INTEGRATION_METEORS_PER_JOB, [&](int begin, int end) {
+            integrate_meteors(meteors, &sim->meteorsNext, begin, end, minX, maxX, minY, maxY);
+        });
+
+        // meteorsNext holds the new state, the old one is reused next step
+        std::swap(sim->meteors, sim->meteorsNext);
+    }
+
+    sim->steps++;
+    update_meteor_churn(sim);
+}
+
+int nearest_meteor(const Simulation *sim, Vector2 *offset) {
+    const MeteorField *meteors = &sim->meteors;
+    const float extentX = wrap_extent(sim->width);
+    const float extentY = wrap_extent(sim->height);
+    int nearest = -1;
+    float nearestDistance = 0.0f;
+    for (int i = 0; i < meteors->count; i++) {
+        float dx = wrap_delta(meteors->positionX[i] - sim->rocket.position.x, extentX);
+        float dy = wrap_delta(meteors->positionY[i] - sim->rocket.position.y, extentY);
+        float distance = dx * dx + dy * dy;
+        if (nearest == -1 || distance < nearestDistance) {
+            nearest = i;
+            nearestDistance = distance;
+            *offset = Vector2{ dx, dy };
+        }
+    }
+    return nearest;
+}
+
+static uint64_t hash_floats(uint64_t hash, const float *values, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        for (int byte = 0; byte < 4; byte++) {
+            hash ^= (bits >> (8 * byte)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+uint64_t simulation_hash(const Simulation *sim) {
+    const Rocket *rocket = &sim->rocket;
+    const MeteorField *meteors = &sim->meteors;
+    const float rocketState[6] = {
+        rocket->position.x, rocket->position.y, rocket->velocity.x, rocket->velocity.y,
+        rocket->rotation, rocket->acceleration
+    };
+
+    uint64_t hash = 14695981039346656037ull;
+    hash = hash_floats(hash, rocketState, 6);
+    hash = hash_floats(hash, meteors->positionX, meteors->count);
+    hash = hash_floats(hash, meteors->positionY, meteors->count);
+    hash = hash_floats(hash, meteors->velocityX, meteors->count);
+    hash = hash_floats(hash, meteors->velocityY, meteors->count);
+    return hash;
+}
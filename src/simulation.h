@@ -0,0 +1,141 @@
+/*
+	Rocket and meteor physics. Nothing in here needs a window, a GL
+	context or loaded textures, so the same step runs both inside the
+	render loop and in headless mode. One call to step_simulation
+	advances the world by one SIMULATION_TIMESTEP.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <raylib.h>
+#include <raymath.h>
+#include "job_system.h"
+#include "meteor_field.h"
+#include "meteor_pool.h"
+#include "sim_random.h"
+
+#define ROCKET_SPEED 6.0f
+#define ROCKET_ROTATION_SPEED 3.0f
+#define ROCKET_ACCELRATION 0.02f
+
+#define METEOR_SPEED 0.5f
+#define METEOR_ANGULAR_SPEED 0.5f
+#define METEOR_DEACCEL 0.0003f
+#define DEFAULT_METEORS 15
+#define MAX_METEORS 100000
+#define DEFAULT_METEOR_CAP 200 // Live meteors waves stop at, when none is given
+#define DEFAULT_WAVE_SIZE 5
+#define METEOR_COLLISION_DAMPING 0.0001f
+#define METEOR_ROCKET_COLLISION_DAMPING 0.1f
+
+// Physics constants above are per step, tuned for 60 steps a second
+#define SIMULATION_TIMESTEP (1.0f / 60.0f)
+
+// Sizes of the sprites in resources/, so wrapping and collision
+// radii match what is drawn without having to load the textures
+#define ROCKET_SPRITE_SIZE 48.0f
+#define ROCKET_SCALE_FACTOR 1.5f
+#define METEOR_SPRITE_SIZE 96.0f
+#define METEOR_COLLISION_RADIUS 13.0f
+#define METEOR_MAX_RADIUS 2.0f // Largest radius add_meteor picks, in METEOR_COLLISION_RADIUS
+// Grid cells fit the widest pair of meteors that can touch
+#define METEOR_GRID_CELL_SIZE (2 * METEOR_MAX_RADIUS * METEOR_COLLISION_RADIUS)
+
+typedef struct Rocket {
+    Vector2 position;
+    Vector2 velocity;
+    float rotation;
+    float acceleration;
+} Rocket;
+
+// Commands to control rocket from virtual port
+enum Command {
+    NOP,
+    ACCEL_POS,    // Acceleration increases by ROCKET_ACCELERATION
+    ACCEL_NEG,
+    ROTATE_RIGHT, // Rotation factor is ROCKET_ROTATION_SPEED
+    ROTATE_LEFT,
+    EXIT          // Sent when emulator wants to shutdown the device
+};
+
+enum BroadPhase {
+    BROAD_PHASE_GRID,      // Uniform grid rebuilt every step, each pair of neighbouring meteors tested once
+    BROAD_PHASE_ALL_PAIRS, // Original O(n^2) loop, kept for comparison
+};
+
+// Uniform grid over the wrapping play area. Meteors are bucketed by
+// cell with a counting sort so the storage is reused between steps.
+// The cells are METEOR_GRID_CELL_SIZE or a little wider, laid out and
+// allocated once by init_simulation.
+typedef struct MeteorGrid {
+    int columns;                   // 0 when the area is too small for a 3x3 grid
+    int rows;
+    float cellWidth;
+    float cellHeight;
+    std::vector<int> cellStart;    // columns * rows + 1 offsets into cellMeteors
+    std::vector<int> cellMeteors;  // Meteor indices sorted by cell
+    std::vector<int> meteorCell;   // Cell of every meteor
+    std::unique_ptr<std::atomic<int>[]> cellCursor; // Per cell counters for the parallel build
+} MeteorGrid;
+
+typedef struct Simulation {
+    int width;
+    int height;
+    Rocket rocket;
+    MeteorField meteors;
+    MeteorField meteorsNext; // Written by step_simulation, then swapped with meteors
+    BroadPhase broadPhase;
+    MeteorGrid grid;
+    JobSystem *jobs;         // Threads to step with, nullptr steps on the calling thread
+    bool deterministic;      // Same result for any thread count (serial grid build)
+    SimRandom random;        // Seeded by init_simulation
+    MeteorPool pool;         // Handles of the meteors in meteors
+    MeteorSpawn spawn;       // Waves and despawning, set with set_meteor_spawn
+    uint64_t steps;          // Steps since init_simulation
+} Simulation;
+
+// Place the rocket in the middle of the screen and spawn meteorCount
+// meteors heading roughly towards it. The same seed spawns the same meteors.
+void init_simulation(Simulation *sim, int width, int height, int meteorCount, uint32_t seed);
+void free_simulation(Simulation *sim);
+
+// Change the meteor churn. Storage for spawn->maxMeteors meteors, the
+// grid's included, is reserved here, so stepping never allocates. May be
+// called between steps, but a change mid-session is not in command logs.
+void set_meteor_spawn(Simulation *sim, const MeteorSpawn *spawn);
+// Add one meteor just outside a random edge, heading for the rocket.
+// Returns NULL_METEOR_HANDLE when the reserved storage is full.
+MeteorHandle spawn_meteor(Simulation *sim);
+// Remove a meteor. The last meteor takes its index, handles stay valid.
+void despawn_meteor(Simulation *sim, MeteorHandle handle);
+
+// Apply a single Command to the rocket. NOP and EXIT do nothing here.
+void apply_command(Rocket *rocket, int command);
+
+// Collision response for every meteor, without moving anything. With the
+// grid broad phase the new velocities go to meteorsNext, the all-pairs
+// loop updates meteors in place. Part of step_simulation, exposed for
+// benchmarking.
+void collide_meteors(Simulation *sim);
+
+// Advance rocket and meteors by one fixed timestep. With the grid broad
+// phase, collisions read meteors and write meteorsNext, so grid rows can
+// be spread over threads. Despawning and waves from sim->spawn run last,
+// on the calling thread.
+void step_simulation(Simulation *sim);
+
+// Index of the meteor whose centre is closest to the rocket, measured
+// the short way around the wrap, and its offset from the rocket.
+// Returns -1 when there are no meteors.
+int nearest_meteor(const Simulation *sim, Vector2 *offset);
+
+// FNV-1a over the bits of the rocket and every meteor, for checking that
+// two runs ended in exactly the same state
+uint64_t simulation_hash(const Simulation *sim);
+
+inline float rocket_draw_size() {
+    return ROCKET_SPRITE_SIZE * ROCKET_SCALE_FACTOR;
+}
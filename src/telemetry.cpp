@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cmath>
+#include "telemetry.h"
+
+#define TELEMETRY_NO_METEOR 0x7FFF
+
+// Round and saturate, a rocket far off screen must not wrap around
+static int16_t to_word(float value) {
+    return (int16_t)std::clamp(lroundf(value), -32768L, 32767L);
+}
+
+void update_telemetry(Telemetry *telemetry, const Simulation *sim) {
+    const Rocket *rocket = &sim->rocket;
+    int16_t *words = telemetry->words;
+    words[TELEMETRY_STEP] = (int16_t)(uint16_t)sim->steps;
+    words[TELEMETRY_ROCKET_X] = to_word(rocket->position.x);
+    words[TELEMETRY_ROCKET_Y] = to_word(rocket->position.y);
+    // What update_rocket adds to the position, the y axis is flipped there
+    words[TELEMETRY_VELOCITY_X] = to_word(256.0f * rocket->velocity.x * rocket->acceleration);
+    words[TELEMETRY_VELOCITY_Y] = to_word(-256.0f * rocket->velocity.y * rocket->acceleration);
+    words[TELEMETRY_HEADING_X] = to_word(256.0f * sinf(rocket->rotation * DEG2RAD));
+    words[TELEMETRY_HEADING_Y] = to_word(-256.0f * cosf(rocket->rotation * DEG2RAD));
+    float rotation = fmodf(rocket->rotation, 360.0f);
+    words[TELEMETRY_ROTATION] = to_word(rotation < 0.0f ? rotation + 360.0f : rotation);
+    words[TELEMETRY_ACCELERATION] = to_word(100.0f * rocket->acceleration);
+
+    Vector2 offset = { 0.0f, 0.0f };
+    int nearest = nearest_meteor(sim, &offset);
+    words[TELEMETRY_METEOR_DX] = to_word(offset.x);
+    words[TELEMETRY_METEOR_DY] = to_word(offset.y);
+    words[TELEMETRY_METEOR_DISTANCE] = nearest == -1 ? TELEMETRY_NO_METEOR : to_word(Vector2Length(offset));
+    words[TELEMETRY_METEOR_RADIUS] = nearest == -1 ? 0 : to_word(sim->meteors.radius[nearest] * METEOR_COLLISION_RADIUS);
+    words[TELEMETRY_METEOR_COUNT] = to_word((float)sim->meteors.count);
+}
+
+static void put_word(unsigned char *out, int16_t value) {
+    out[0] = (uint16_t)value & 0xFF;
+    out[1] = (uint16_t)value >> 8;
+}
+
+void publish_telemetry(Telemetry *telemetry, VirtualDevice *device, long portBase) {
+    int16_t *words = telemetry->words;
+    unsigned char block[TELEMETRY_SIZE];
+    const long base = portBase + TELEMETRY_BASE_PORT;
+
+    // Odd: a reader that sees this, or sees it change, reads again
+    words[TELEMETRY_SEQUENCE] = (int16_t)((uint16_t)words[TELEMETRY_SEQUENCE] + 1);
+    put_word(block, words[TELEMETRY_SEQUENCE]);
+    write_device_block(device, base, block, 2);
+
+    for (int i = 1; i < TELEMETRY_WORDS; i++)
+        put_word(block + 2 * i, words[i]);
+    write_device_block(device, base + 2, block + 2, TELEMETRY_SIZE - 2);
+
+    words[TELEMETRY_SEQUENCE] = (int16_t)((uint16_t)words[TELEMETRY_SEQUENCE] + 1);
+    put_word(block, words[TELEMETRY_SEQUENCE]);
+    write_device_block(device, base, block, 2);
+}
@@ -0,0 +1,24 @@
+/*
+	Rocket state for the 8086 program, published into the telemetry
+	block of port_protocol.h. update_telemetry converts the simulation
+	into the block's words. publish_telemetry writes them with one
+	block write, bracketed by the two sequence writes the program uses
+	to detect a torn frame. That is three writes a frame instead of a
+	write_port_word per value.
+*/
+#pragma once
+
+#include <cstdint>
+#include "port_protocol.h"
+#include "simulation.h"
+#include "virtual.h"
+
+typedef struct Telemetry {
+    int16_t words[TELEMETRY_WORDS]; // TELEMETRY_SEQUENCE is the last one published
+} Telemetry;
+
+// Fill every word but TELEMETRY_SEQUENCE from sim
+void update_telemetry(Telemetry *telemetry, const Simulation *sim);
+// Write the words to the block at portBase + TELEMETRY_BASE_PORT and
+// advance the sequence by two
+void publish_telemetry(Telemetry *telemetry, VirtualDevice *device, long portBase = 0);
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <raylib.h>
+#include <rlgl.h>
+#include "text_layer.h"
+
+void init_text_layer(TextLayer *layer, int width, int height) {
+    *layer = TextLayer{};
+    layer->target = LoadRenderTexture(width, height);
+}
+
+void unload_text_layer(TextLayer *layer) {
+    UnloadRenderTexture(layer->target);
+    *layer = TextLayer{};
+}
+
+void begin_text_layer(TextLayer *layer) {
+    layer->pendingCount = 0;
+}
+
+void text_layer_line(TextLayer *layer, const Font *font, Vector2 position, float fontSize, Color color, const char *format, ...) {
+    if (layer->pendingCount == TEXT_LAYER_MAX_LINES)
+        return;
+    TextLine *line = &layer->pending[layer->pendingCount++];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line->text, TEXT_LINE_SIZE, format, args);
+    va_end(args);
+    line->font = font;
+    line->position = position;
+    line->fontSize = fontSize;
+    line->color = color;
+}
+
+static bool same_line(const TextLine *a, const TextLine *b) {
+    return a->font == b->font && a->position.x == b->position.x && a->position.y == b->position.y
+        && a->fontSize == b->fontSize && ColorToInt(a->color) == ColorToInt(b->color)
+        && strcmp(a->text, b->text) == 0;
+}
+
+static bool lines_changed(const TextLayer *layer) {
+    if (layer->pendingCount != layer->lineCount)
+        return true;
+    for (int i = 0; i < layer->lineCount; i++) {
+        if (!same_line(&layer->lines[i], &layer->pending[i]))
+            return true;
+    }
+    return false;
+}
+
+void end_text_layer(TextLayer *layer) {
+    if (!lines_changed(layer))
+        return;
+    memcpy(layer->lines, layer->pending, layer->pendingCount * sizeof(TextLine));
+    layer->lineCount = layer->pendingCount;
+
+    BeginTextureMode(layer->target);
+    ClearBackground(BLANK);
+    // Keep the texture premultiplied: colour blends as usual but alpha
+    // accumulates linearly, otherwise glyph edges come out too dark
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE, RL_ONE_MINUS_SRC_ALPHA, RL_FUNC_ADD, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+    for (int i = 0; i < layer->lineCount; i++) {
+        const TextLine *line = &layer->lines[i];
+        DrawTextEx(*line->font, line->text, line->position, line->fontSize, 1.0f, line->color);
+    }
+    EndBlendMode();
+    EndTextureMode();
+}
+
+void draw_text_layer(const TextLayer *layer, Vector2 position) {
+    if (layer->lineCount == 0)
+        return;
+    const Texture2D &texture = layer->target.texture;
+    // Render textures are stored bottom up. Whole pixels keep the text sharp.
+    Rectangle source = { 0.0f, 0.0f, (float)texture.width, -(float)texture.height };
+    BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+    DrawTextureRec(texture, source, Vector2{ roundf(position.x), roundf(position.y) }, WHITE);
+    EndBlendMode();
+}
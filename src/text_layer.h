@@ -0,0 +1,46 @@
+/*
+	Cached block of debug text. Every frame the caller formats its lines
+	into the layer between begin_text_layer and end_text_layer. Those
+	are cheap string writes. Only when a line differs from the last
+	frame, as printed, is the text drawn again with DrawTextEx into the
+	layer's RenderTexture2D. draw_text_layer then draws that texture as
+	one quad, so an idle HUD costs one draw instead of one per glyph.
+
+	Line positions are relative to the layer's top left corner.
+	end_text_layer may switch the render target, so call it before
+	BeginDrawing or outside any shader or texture mode.
+*/
+#pragma once
+
+#include <raylib.h>
+
+#define TEXT_LAYER_MAX_LINES 16
+#define TEXT_LINE_SIZE 64
+
+typedef struct TextLine {
+    char text[TEXT_LINE_SIZE];
+    const Font *font;
+    Vector2 position;
+    float fontSize;
+    Color color;
+} TextLine;
+
+typedef struct TextLayer {
+    RenderTexture2D target;
+    TextLine lines[TEXT_LAYER_MAX_LINES];   // Lines in the texture
+    TextLine pending[TEXT_LAYER_MAX_LINES]; // Lines formatted this frame
+    int lineCount;
+    int pendingCount;
+} TextLayer;
+
+void init_text_layer(TextLayer *layer, int width, int height);
+void unload_text_layer(TextLayer *layer);
+
+void begin_text_layer(TextLayer *layer);
+// printf style. Lines past TEXT_LAYER_MAX_LINES are dropped and text is
+// cut at TEXT_LINE_SIZE - 1 characters.
+void text_layer_line(TextLayer *layer, const Font *font, Vector2 position, float fontSize, Color color, const char *format, ...);
+// Redraw the texture if the lines changed
+void end_text_layer(TextLayer *layer);
+
+void draw_text_layer(const TextLayer *layer, Vector2 position);
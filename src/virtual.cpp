@@ -0,0 +1,139 @@
+/*
+	Platform specific setup of the virtual device file. Kept out of
+	virtual.h so <windows.h> never meets raylib.h in the same
+	translation unit (Rectangle, CloseWindow, DrawText clash).
+*/
+#include "virtual.h"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+VirtualDevice ioDevice = {};
+
+const char *virtual_device_path() {
+	const char *envPath = getenv(IO_PATH_ENV);
+	if (envPath != NULL && envPath[0] != '\0')
+		return envPath;
+	return IO_FILE_PATH;
+}
+
+// Map at least minSize bytes of the file shared with the emulator.
+// Returns 0 on success, -1 if the file could not be opened or mapped.
+static int map_virtual_device(VirtualDevice *device, const char *path, size_t minSize) {
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return -1;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return -1;
+	}
+	size_t size = (size_t)fileSize.QuadPart;
+	if (size < minSize)
+		size = minSize;
+
+	// Mapping more than the file size grows the file
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, (DWORD)size, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return -1;
+	}
+	void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return -1;
+	}
+	device->fileHandle = file;
+	device->mappingHandle = mapping;
+#else
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	size_t size = (size_t)st.st_size;
+	if (size < minSize) {
+		if (ftruncate(fd, minSize) != 0) {
+			close(fd);
+			return -1;
+		}
+		size = minSize;
+	}
+
+	void *view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if (view == MAP_FAILED)
+		return -1;
+#endif
+	device->ports = (volatile unsigned char *)view;
+	device->mappedSize = size;
+	return 0;
+}
+
+int open_virtual_device(VirtualDevice *device, const char *path, IoTransport transport, size_t minSize) {
+	*device = VirtualDevice{};
+	if (path == NULL)
+		path = virtual_device_path();
+
+	if (transport != IO_TRANSPORT_STDIO) {
+		if (map_virtual_device(device, path, minSize) == 0) {
+			device->transport = IO_TRANSPORT_MMAP;
+			return 0;
+		}
+		if (transport == IO_TRANSPORT_MMAP) {
+			fprintf(stderr, FILE_ERR, path);
+			return -1;
+		}
+		fprintf(stderr, MAP_ERR, path);
+	}
+
+	device->file = fopen(path, "r+");
+	if (device->file == NULL) {
+		fprintf(stderr, FILE_ERR, path);
+		return -1;
+	}
+	device->transport = IO_TRANSPORT_STDIO;
+	return 0;
+}
+
+void close_virtual_device(VirtualDevice *device) {
+	is_virtual_device_initalized(device);
+	if (device->ports != NULL) {
+#if defined(_WIN32)
+		FlushViewOfFile((LPCVOID)device->ports, device->mappedSize);
+		UnmapViewOfFile((LPCVOID)device->ports);
+		CloseHandle((HANDLE)device->mappingHandle);
+		CloseHandle((HANDLE)device->fileHandle);
+#else
+		munmap((void *)device->ports, device->mappedSize);
+#endif
+	}
+	if (device->file != NULL)
+		fclose(device->file);
+	*device = VirtualDevice{};
+}
+
+int init_virtual_device(const char *path, IoTransport transport) {
+	return open_virtual_device(&ioDevice, path, transport);
+}
+
+void free_virtual_device() {
+	close_virtual_device(&ioDevice);
+}
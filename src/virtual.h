@@ -3,58 +3,145 @@
 	the virtual device file c:/emu8086.io. We can set values
 	at different ports using the write_* functions in this file.
 	Be sure to call the init_virtual_device function before calling
-	any read or write function to setup handlers to the file. Call 
+	any read or write function to setup handlers to the file. Call
 	free_virtual_device after finishing and need to exit program.
+
+	The file is memory-mapped when possible so a port access is a
+	plain load/store into the shared page. If mapping fails (or the
+	stdio transport is requested) we fall back to fseek/fgetc/fputc.
+	The path can be overridden with the EMU8086_IO_PATH environment
+	variable (e.g. ~/.wine/drive_c/emu8086.io on Linux).
 */
+#pragma once
+
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#if defined(_MSC_VER)
+	#include <intrin.h> // _InterlockedExchange8, no <windows.h> needed
+#endif
 
-#define FILE_ERR "Cannot open C:/emu8086.io\n"
+#define FILE_ERR "Cannot open %s\n"
+#define MAP_ERR "Cannot map %s, falling back to stdio\n"
 #define IO_NOT_INIT_ERR "Call init_virtual_device first\n"
 
+#define IO_PATH_ENV "EMU8086_IO_PATH"
+// Minimum number of bytes (ports) mapped from the I/O file. The file
+// is grown to this size if it is shorter.
+#define IO_MAP_SIZE 1024
+
 const char IO_FILE_PATH[] = "c:/emu8086.io";
-FILE *ioFileHandler = NULL;
 
-inline void is_virtual_device_initalized() {
-	if (ioFileHandler == NULL) {
+enum IoTransport {
+	IO_TRANSPORT_AUTO,  // Try mmap first, fall back to stdio
+	IO_TRANSPORT_MMAP,
+	IO_TRANSPORT_STDIO,
+};
+
+// One open device file. Several can be open at once, each instance of
+// a batch run (see instance_pool.h) can have its own.
+typedef struct VirtualDevice {
+	FILE *file;                     // stdio transport
+	volatile unsigned char *ports;  // mmap transport
+	size_t mappedSize;
+	IoTransport transport;
+	void *fileHandle;               // Windows file and mapping handles
+	void *mappingHandle;
+} VirtualDevice;
+
+// The device behind init_virtual_device and the *_port_* functions
+extern VirtualDevice ioDevice;
+
+// Path used when none is given: EMU8086_IO_PATH or IO_FILE_PATH
+const char *virtual_device_path();
+
+// Open path as device. With mmap at least minSize bytes are mapped, the
+// file is grown if it is shorter. Returns non-zero on failure.
+int open_virtual_device(VirtualDevice *device, const char *path, IoTransport transport = IO_TRANSPORT_AUTO,
+	size_t minSize = IO_MAP_SIZE);
+void close_virtual_device(VirtualDevice *device);
+
+// Get a handle to the file. Reduce repeated fopen() kernel calls
+int init_virtual_device(const char *path = nullptr, IoTransport transport = IO_TRANSPORT_AUTO);
+void free_virtual_device();
+
+inline void is_virtual_device_initalized(const VirtualDevice *device = &ioDevice) {
+	if (device->file == NULL && device->ports == NULL) {
 		fprintf(stderr, IO_NOT_INIT_ERR);
 		exit(EXIT_FAILURE);
 	}
 }
 
-// Get a handle to the file. Reduce repeated fopen() kernel calls
-int init_virtual_device() {
-	ioFileHandler = fopen(IO_FILE_PATH,"r+");
-	if (ioFileHandler == NULL) {
-		fprintf(stderr, FILE_ERR);
-		return -1;
+inline int read_device_byte(VirtualDevice *device, long port) {
+	is_virtual_device_initalized(device);
+	if (device->ports != NULL) {
+		int ch = device->ports[port];
+		// Nothing after this load may be hoisted above it
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return ch;
 	}
-	return 0;
+	FILE *fp = device->file;
+	int ch;
+	fseek(fp, port, SEEK_SET);
+	ch = fgetc(fp);
+	return ch;
 }
 
-void free_virtual_device() {
-	is_virtual_device_initalized();
-	fclose(ioFileHandler);
+inline void write_device_byte(VirtualDevice *device, long port, unsigned char uValue) {
+	is_virtual_device_initalized(device);
+	if (device->ports != NULL) {
+		// Everything before this store must be visible first
+		std::atomic_thread_fence(std::memory_order_release);
+		device->ports[port] = uValue;
+		return;
+	}
+	FILE *fp = device->file;
+	fseek(fp, port, SEEK_SET);
+	fputc(uValue, fp);
 }
 
-int read_port_byte(long port) {
-	is_virtual_device_initalized();
-	FILE *fp = ioFileHandler;
-	int ch;
-	fseek(fp, port, SEEK_SET);
-    ch = fgetc(fp);
+// Store uValue and return what the port held. With mmap this is one
+// atomic exchange, so a write by the program cannot land between the
+// read and the store. Through stdio it is a read and a write.
+inline int exchange_device_byte(VirtualDevice *device, long port, unsigned char uValue) {
+	is_virtual_device_initalized(device);
+	if (device->ports != NULL) {
+#if defined(_MSC_VER)
+		return (unsigned char)_InterlockedExchange8((volatile char *)(device->ports + port), (char)uValue);
+#else
+		return __atomic_exchange_n((unsigned char *)(device->ports + port), uValue, __ATOMIC_ACQ_REL);
+#endif
+	}
+	int ch = read_device_byte(device, port);
+	write_device_byte(device, port, uValue);
 	return ch;
 }
 
-void write_port_byte(long port, unsigned char uValue) {
-	is_virtual_device_initalized();
-	FILE *fp = ioFileHandler;
+// Copy size bytes to the ports from port on, as one memcpy into the
+// mapping or one fwrite instead of a call per byte
+inline void write_device_block(VirtualDevice *device, long port, const void *bytes, size_t size) {
+	is_virtual_device_initalized(device);
+	if (device->ports != NULL) {
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy((void *)(device->ports + port), bytes, size);
+		return;
+	}
+	FILE *fp = device->file;
 	fseek(fp, port, SEEK_SET);
-	fputc(uValue, fp); 
+	fwrite(bytes, 1, size, fp);
+	fflush(fp);
+}
+
+inline int read_port_byte(long port) {
+	return read_device_byte(&ioDevice, port);
 }
 
-short int read_port_word(long port) {
+inline void write_port_byte(long port, unsigned char uValue) {
+	write_device_byte(&ioDevice, port, uValue);
+}
+
+inline short int read_port_word(long port) {
 	is_virtual_device_initalized();
 	short int word;
 	unsigned char tb1;
@@ -65,14 +152,14 @@ short int read_port_word(long port) {
 
 	// Convert 2 bytes to a 16 bit word:
 	word = tb2;
-    word = word << 8;
+	word = word << 8;
 	word = word + tb1;
 
 	return word;
 }
 
-void write_port_word(long port, short int iValue) {
+inline void write_port_word(long port, short int iValue) {
 	is_virtual_device_initalized();
 	write_port_byte (port, iValue & 0x00FF);
 	write_port_byte (port + 1, (iValue & 0xFF00) >> 8);
-}
\ No newline at end of file
+}
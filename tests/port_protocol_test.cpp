@@ -0,0 +1,189 @@
+/*
+	Checks of the legacy (version 1) handshake and the telemetry block
+	in port_protocol. The program side is played here through the same
+	device, on a scratch file in the working directory, once per
+	transport, or on a thread of its own next to an instance pool.
+	Exits non-zero if a check fails.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "../src/instance_pool.h"
+#include "../src/port_protocol.h"
+#include "../src/virtual.h"
+
+#define TEST_PORT_PATH "port_protocol_test.io"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Fresh scratch file, every port 0
+static bool create_test_file() {
+    FILE *fp = fopen(TEST_PORT_PATH, "wb");
+    if (fp == NULL)
+        return false;
+    unsigned char zeros[IO_MAP_SIZE] = {};
+    fwrite(zeros, 1, sizeof(zeros), fp);
+    fclose(fp);
+    return true;
+}
+
+static bool open_test_device(VirtualDevice *device, IoTransport transport) {
+    if (!create_test_file() || open_virtual_device(device, TEST_PORT_PATH, transport) != 0) {
+        CHECK(!"cannot open " TEST_PORT_PATH);
+        return false;
+    }
+    return true;
+}
+
+static void close_test_device(VirtualDevice *device) {
+    close_virtual_device(device);
+    remove(TEST_PORT_PATH);
+}
+
+// A v1 program that wants to send a command reads STATUS_PORT and only
+// writes COMMAND_PORT when it says COMMAND_READY. Returns true if it wrote.
+static bool program_try_send(VirtualDevice *device, unsigned char command) {
+    if (read_device_byte(device, STATUS_PORT) != Status::COMMAND_READY)
+        return false;
+    write_device_byte(device, COMMAND_PORT, command);
+    return true;
+}
+
+// Commands written back to back: the program writes one, as it would
+// right after seeing COMMAND_READY, then tries to write the next one at
+// once. The device must hold it back until the first one was read.
+static void test_back_to_back_writes(IoTransport transport) {
+    VirtualDevice device;
+    if (!open_test_device(&device, transport))
+        return;
+    write_device_byte(&device, STATUS_PORT, Status::READY);
+
+    PortProtocol protocol;
+    init_port_protocol(&protocol, &device);
+    CHECK(protocol.version == PROTOCOL_VERSION_LEGACY);
+    CHECK(read_device_byte(&device, STATUS_PORT) == Status::COMMAND_NOT_READY);
+
+    const unsigned char sent[] = { 1, 2, 3, 4, 1, 1, 3, 2 };
+    unsigned char received[RING_SIZE];
+    int receivedTotal = 0;
+    for (unsigned char command : sent) {
+        write_device_byte(&device, COMMAND_PORT, command);
+        CHECK(!program_try_send(&device, 4));
+        CHECK(read_device_byte(&device, COMMAND_PORT) == command);
+
+        int count = receive_port_commands(&protocol, received, RING_SIZE);
+        CHECK(count == 1);
+        CHECK(count < 1 || received[0] == command);
+        receivedTotal += count;
+        CHECK(read_device_byte(&device, STATUS_PORT) == Status::COMMAND_NOT_READY);
+        CHECK(read_device_byte(&device, COMMAND_PORT) == 0);
+    }
+    CHECK(receivedTotal == (int)sizeof(sent));
+
+    // Nothing written, nothing received, and still not ready afterwards
+    CHECK(receive_port_commands(&protocol, received, RING_SIZE) == 0);
+    CHECK(read_device_byte(&device, STATUS_PORT) == Status::COMMAND_NOT_READY);
+
+    free_port_protocol(&protocol);
+    close_test_device(&device);
+}
+
+// A v1 program that checks STATUS_PORT every 200 us and takes 50 ms
+// between commands, like someone typing, against a pool stepped once
+// per 16 ms frame like the windowed batch loop. It only sees
+// COMMAND_READY while its instance polls, so every command has to get
+// in during one of those windows.
+static void test_slow_writer_through_pool() {
+    // The shared device of a pool is the default device file
+#if defined(_WIN32)
+    _putenv_s(IO_PATH_ENV, TEST_PORT_PATH);
+#else
+    setenv(IO_PATH_ENV, TEST_PORT_PATH, 1);
+#endif
+    InstancePool pool;
+    if (!create_test_file() || init_instance_pool(&pool, 1, 1024, 600, 8, 1, INSTANCE_PORTS_RANGE, nullptr, PROTOCOL_PORT_COUNT, nullptr) != 0) {
+        CHECK(!"cannot create the instance pool");
+        return;
+    }
+    VirtualDevice *device = &pool.sharedDevice;
+    write_device_byte(device, STATUS_PORT, Status::READY);
+
+    const unsigned char sent[] = { 1, 3, 4, 2, 3, 3 };
+    std::atomic<bool> stop{false};
+    std::thread program([&] {
+        for (unsigned char command : sent) {
+            while (!program_try_send(device, command)) {
+                if (stop.load())
+                    return;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    });
+
+    const SimInstance *instance = &pool.instances[0];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (instance->commandsApplied < (long)sizeof(sent) && std::chrono::steady_clock::now() < deadline) {
+        step_instance_pool(&pool);
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    stop.store(true);
+    program.join();
+
+    CHECK(instance->connected);
+    CHECK(instance->commandsApplied == (long)sizeof(sent));
+    CHECK(instance->lastCommand == sent[sizeof(sent) - 1]);
+    free_instance_pool(&pool);
+    remove(TEST_PORT_PATH);
+}
+
+static int telemetry_sequence(VirtualDevice *device) {
+    return read_device_byte(device, TELEMETRY_PORT(TELEMETRY_SEQUENCE))
+        | read_device_byte(device, TELEMETRY_PORT(TELEMETRY_SEQUENCE) + 1) << 8;
+}
+
+// A block with no frame in it must never pass a reader's sequence check:
+// the sequence has to be odd before the first frame and after the end
+static void test_telemetry_without_frame(IoTransport transport) {
+    VirtualDevice device;
+    if (!open_test_device(&device, transport))
+        return;
+    // A complete frame left behind by an earlier run
+    const unsigned char stale[TELEMETRY_SIZE] = { 8, 0, 1, 0, 200, 0 };
+    write_device_block(&device, TELEMETRY_BASE_PORT, stale, sizeof(stale));
+    write_device_byte(&device, STATUS_PORT, Status::READY);
+
+    PortProtocol protocol;
+    init_port_protocol(&protocol, &device);
+    CHECK(telemetry_sequence(&device) % 2 == 1);
+    CHECK(read_device_byte(&device, TELEMETRY_PORT(TELEMETRY_ROCKET_X)) == 0);
+
+    free_port_protocol(&protocol);
+    CHECK(telemetry_sequence(&device) % 2 == 1);
+    CHECK(read_device_byte(&device, TELEMETRY_PORT(TELEMETRY_ROCKET_X)) == 0);
+    close_test_device(&device);
+}
+
+int main() {
+    test_back_to_back_writes(IO_TRANSPORT_MMAP);
+    test_back_to_back_writes(IO_TRANSPORT_STDIO);
+    test_slow_writer_through_pool();
+    test_telemetry_without_frame(IO_TRANSPORT_MMAP);
+    test_telemetry_without_frame(IO_TRANSPORT_STDIO);
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All port protocol checks passed\n");
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+	Checks of the simulation core that need no device: stepping with
+	meteor churn must not allocate once set_meteor_spawn reserved the
+	storage. Allocations are counted by replacing the global operator
+	new. Exits non-zero if a check fails.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "../src/job_system.h"
+#include "../src/simulation.h"
+
+#define TEST_WIDTH 1020
+#define TEST_HEIGHT 600
+#define TEST_SEED 1
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static std::atomic<long> allocations{0};
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size != 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// malloc has no portable aligned form, so over-allocate and keep the
+// pointer to free just below the aligned block
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = (size_t)alignment;
+    void *raw = malloc(size + align + sizeof(void *));
+    if (raw == NULL)
+        throw std::bad_alloc();
+    uintptr_t aligned = ((uintptr_t)raw + sizeof(void *) + align - 1) & ~(uintptr_t)(align - 1);
+    ((void **)aligned)[-1] = raw;
+    return (void *)aligned;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, std::size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept {
+    if (p != NULL)
+        free(((void **)p)[-1]);
+}
+void operator delete(void *p, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+
+// Meteors spawn in waves, expire and get destroyed by the rocket, so the
+// live count moves up and down through the whole run
+static void test_churn_without_allocations(JobSystem *jobs, bool deterministic) {
+    Simulation sim = {};
+    init_simulation(&sim, TEST_WIDTH, TEST_HEIGHT, 50, TEST_SEED);
+    sim.jobs = jobs;
+    sim.deterministic = deterministic;
+    MeteorSpawn spawn = { 2, 20, 1000, 120, true };
+    set_meteor_spawn(&sim, &spawn);
+    sim.rocket.acceleration = 0.5f;
+
+    int fewest = sim.meteors.count, most = sim.meteors.count;
+    long before = allocations.load();
+    for (int step = 0; step < 600; step++) {
+        if (step % 20 == 0)
+            apply_command(&sim.rocket, Command::ROTATE_RIGHT);
+        step_simulation(&sim);
+        fewest = std::min(fewest, sim.meteors.count);
+        most = std::max(most, sim.meteors.count);
+    }
+    long made = allocations.load() - before;
+    if (made != 0)
+        fprintf(stderr, "%ld allocations while stepping\n", made);
+    CHECK(made == 0);
+    // The churn actually happened
+    CHECK(most > 500);
+    CHECK(fewest < most);
+    free_simulation(&sim);
+}
+
+int main() {
+    test_churn_without_allocations(nullptr, true);
+    JobSystem jobs;
+    init_job_system(&jobs, 2);
+    test_churn_without_allocations(&jobs, true);
+    test_churn_without_allocations(&jobs, false);
+    free_job_system(&jobs);
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All simulation checks passed\n");
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+	Bakes the asset pack ahead of time, so even the first run of the
+	game maps it instead of building it.
+
+	bake_assets <resourceDir> <packPath> [width height]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include "../src/asset_pack.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3 && argc != 5) {
+        fprintf(stderr, "Usage: %s <resourceDir> <packPath> [width height]\n", argv[0]);
+        return 1;
+    }
+    int width = argc == 5 ? atoi(argv[3]) : SCREEN_WIDTH;
+    int height = argc == 5 ? atoi(argv[4]) : SCREEN_HEIGHT;
+    SetTraceLogLevel(LOG_WARNING);
+    if (bake_asset_pack(argv[1], argv[2], width, height) != 0)
+        return 1;
+    printf("Baked %s (%ldKB)\n", argv[2], (long)GetFileLength(argv[2]) / 1024);
+    return 0;
+}